@@ -0,0 +1,177 @@
+// j/clients scanning cost at 10, 100 and 1000 clients, for json_scan and
+// for the brace-matching get_json_value() parser it replaced: time per
+// reply, throughput, and heap allocations per reply (expected 0 for
+// json_scan). Exits non-zero if json_scan allocates. Run with
+// `meson test --benchmark`.
+#include "../include/json_scan.h"
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+// A reply shaped like hyprctl's, every field a real one carries
+static std::string make_clients(int count) {
+    std::string json = "[";
+    for (int i = 0; i < count; i++) {
+        char client[1024];
+        std::snprintf(client, sizeof(client),
+            "%s{\n"
+            "    \"address\": \"0x55d0c1%06x\",\n"
+            "    \"mapped\": true,\n"
+            "    \"hidden\": false,\n"
+            "    \"at\": [%d, %d],\n"
+            "    \"size\": [%d, %d],\n"
+            "    \"workspace\": {\n"
+            "        \"id\": %d,\n"
+            "        \"name\": \"%d\"\n"
+            "    },\n"
+            "    \"floating\": %s,\n"
+            "    \"pseudo\": false,\n"
+            "    \"monitor\": %d,\n"
+            "    \"class\": \"kitty\",\n"
+            "    \"title\": \"~/src/vidwall \\\"window %d\\\"\",\n"
+            "    \"initialClass\": \"kitty\",\n"
+            "    \"initialTitle\": \"kitty\",\n"
+            "    \"pid\": %d,\n"
+            "    \"xwayland\": false,\n"
+            "    \"pinned\": false,\n"
+            "    \"fullscreen\": 0,\n"
+            "    \"fullscreenClient\": 0,\n"
+            "    \"grouped\": [],\n"
+            "    \"tags\": [],\n"
+            "    \"swallowing\": \"0x0\",\n"
+            "    \"focusHistoryID\": %d,\n"
+            "    \"inhibitingIdle\": false\n"
+            "}",
+            i > 0 ? "," : "", i, (i * 37) % 1920, (i * 53) % 1080, 800 + i % 400, 600 + i % 300,
+            1 + i % 10, 1 + i % 10, i % 7 == 0 ? "true" : "false", i % 2, i, 1000 + i, i);
+        json += client;
+    }
+    json += "]";
+    return json;
+}
+
+// The previous parser, as it was in hyprland_ipc.cpp: every client object
+// copied out by brace matching, then searched for each key
+static std::string get_json_value(const std::string& json, const std::string& key) {
+    std::string search = "\"" + key + "\":";
+    size_t pos = json.find(search);
+    if (pos == std::string::npos) return "";
+
+    pos += search.length();
+
+    // Skip whitespace
+    while (pos < json.length() && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == '\r')) pos++;
+
+    if (pos >= json.length()) return "";
+
+    if (json[pos] == '"') {
+        // String value
+        size_t end = json.find('"', pos + 1);
+        if (end != std::string::npos) {
+            return json.substr(pos + 1, end - pos - 1);
+        }
+    } else {
+        // Number or boolean
+        size_t end = pos;
+        while (end < json.length() && (isdigit(json[end]) || json[end] == '.' || json[end] == '-')) end++;
+        return json.substr(pos, end - pos);
+    }
+    return "";
+}
+
+// Same loop as the old per-workspace window count: the workspace id and
+// class of every client. json_scan reads every field vidwall uses now
+// (address, geometry, flags), so the comparison favours the old parser.
+static bool legacy_scan(const std::string& clients_json, long& sum) {
+    size_t pos = clients_json.find('[');
+    if (pos == std::string::npos) return false;
+    pos++;
+
+    while (pos < clients_json.length()) {
+        size_t start = clients_json.find('{', pos);
+        if (start == std::string::npos) break;
+
+        // Find matching closing brace
+        int depth = 1;
+        size_t current = start + 1;
+        bool in_string = false;
+        while (current < clients_json.length() && depth > 0) {
+            char c = clients_json[current];
+            if (c == '"' && (current == 0 || clients_json[current-1] != '\\')) {
+                in_string = !in_string;
+            } else if (!in_string) {
+                if (c == '{') depth++;
+                else if (c == '}') depth--;
+            }
+            current++;
+        }
+        if (depth != 0) return false;
+
+        std::string client_obj = clients_json.substr(start, current - start);
+        size_t ws_pos = client_obj.find("\"workspace\":");
+        if (ws_pos != std::string::npos) {
+            std::string ws_part = client_obj.substr(ws_pos);
+            std::string id_val = get_json_value(ws_part, "id");
+            std::string class_val = get_json_value(client_obj, "class");
+            sum += std::atoi(id_val.c_str()) + static_cast<long>(class_val.size());
+        }
+        pos = current;
+    }
+    return true;
+}
+
+static bool new_scan(const std::string& json, long& sum) {
+    return json_scan::for_each_client(json, [&sum](const json_scan::ClientView& client) {
+        sum += client.width + static_cast<long>(client.address.size());
+    });
+}
+
+// Allocations per reply, or -1 if the reply did not parse
+static double run(const char *parser, int count, const std::string& json, bool (*scan)(const std::string&, long&)) {
+    long iterations = 2000000 / count;
+
+    volatile long sink = 0;
+    size_t allocations_before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        long sum = 0;
+        if (!scan(json, sum)) {
+            std::fprintf(stderr, "%s, %d clients: reply not parsed\n", parser, count);
+            return -1.0;
+        }
+        sink = sink + sum;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double allocs_per_reply = static_cast<double>(allocations - allocations_before) / iterations;
+
+    double us_per_reply = seconds * 1e6 / iterations;
+    std::printf("parser=%-9s clients=%-5d bytes=%-7zu us/reply=%-9.2f ns/client=%-7.1f MB/s=%-8.0f "
+                "allocs/reply=%.2f\n",
+                parser, count, json.size(), us_per_reply, us_per_reply * 1000.0 / count,
+                json.size() * iterations / seconds / 1e6, allocs_per_reply);
+    return allocs_per_reply;
+}
+
+int main() {
+    bool ok = true;
+    for (int count : {10, 100, 1000}) {
+        std::string json = make_clients(count);
+        if (run("legacy", count, json, legacy_scan) < 0.0) ok = false;
+        if (run("json_scan", count, json, new_scan) != 0.0) ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+// Per-frame cost of each presentation backend with the same mpv setup:
+// GTK's GL area (gtk), own layer surfaces with EGL (wayland) and own layer
+// surfaces with mpv's software renderer into wl_shm buffers (software).
+// A synthetic 1080p60 source plays on the first monitor through
+// WallpaperOutput, as vidwall would play it; after a warm-up the process
+// CPU time (mpv's and the GL driver's threads included) is divided by the
+// frames presented. With LIBGL_ALWAYS_SOFTWARE=1 the GL backends run on
+// llvmpipe, for the comparison with software.
+//
+// Needs a compositor with wlr-layer-shell and exits 77 (skipped) without
+// WAYLAND_DISPLAY; bench/headless.sh runs it under a headless sway. A
+// backend that presents nothing fails the run. Backends can be named as
+// arguments, all three run by default.
+#include "../include/wallpaper_output.h"
+#include "../include/wayland_backend.h"
+#include "../include/resource_usage.h"
+#include <gtk/gtk.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+static constexpr const char *SOURCE = "av://lavfi:testsrc2=size=1920x1080:rate=60";
+static constexpr guint WARMUP_MS = 2000;
+static constexpr guint MEASURE_MS = 5000;
+static constexpr int SKIPPED = 77;
+
+struct Bench {
+    std::vector<std::string> backends;
+    int ran = 0;
+    bool failed = false;
+};
+
+static gboolean on_deadline(gpointer user_data) {
+    *static_cast<bool*>(user_data) = true;
+    return G_SOURCE_REMOVE;
+}
+
+// Blocks in the main loop, where the output renders and presents
+static void run_main_loop(guint ms) {
+    bool done = false;
+    g_timeout_add(ms, on_deadline, &done);
+    while (!done) g_main_context_iteration(nullptr, TRUE);
+}
+
+// False if the backend presented nothing; unavailable backends are
+// reported and skipped
+static bool run_backend(GtkApplication *app, GdkMonitor *monitor, const std::string& backend, Bench& bench) {
+    CliArgs args;
+    args.video_path = SOURCE;
+    args.auto_pause = false;
+    args.backend = backend;
+
+    std::unique_ptr<WaylandConnection> wayland;
+    if (backend != "gtk") {
+        wayland = std::make_unique<WaylandConnection>();
+        if (!wayland->connect(backend != "software")) {
+            std::printf("backend=%-9s skipped, no direct Wayland connection\n", backend.c_str());
+            return true;
+        }
+    }
+
+    auto output = std::make_unique<WallpaperOutput>(app, monitor, args, Visibility::Visible, nullptr,
+                                                    wayland.get());
+    if (!output->start()) {
+        std::printf("backend=%-9s skipped, output not started\n", backend.c_str());
+        return true;
+    }
+    if (wayland && !output->direct_surface()) {
+        std::printf("backend=%-9s skipped, fell back to GTK\n", backend.c_str());
+        return true;
+    }
+
+    run_main_loop(WARMUP_MS);
+    output->take_present_count();
+    int64_t cpu_start = resource_usage::cpu_time_us();
+    auto start = std::chrono::steady_clock::now();
+    run_main_loop(MEASURE_MS);
+    uint64_t presents = output->take_present_count();
+    int64_t cpu_us = resource_usage::cpu_time_us() - cpu_start;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int width = 0, height = 0;
+    output->monitor_pixel_size(width, height);
+    output.reset();
+    wayland.reset();
+    bench.ran++;
+
+    if (presents == 0) {
+        std::fprintf(stderr, "backend=%s: nothing presented\n", backend.c_str());
+        return false;
+    }
+    std::printf("backend=%-9s output=%dx%d presents/s=%-7.1f cpu_ms/frame=%-7.3f cpu=%.0f%%\n",
+                backend.c_str(), width, height, presents / seconds, cpu_us / 1000.0 / presents,
+                cpu_us / 1e4 / seconds);
+    return true;
+}
+
+static void on_activate(GtkApplication *app, gpointer user_data) {
+    auto *bench = static_cast<Bench*>(user_data);
+
+    GListModel *monitors = gdk_display_get_monitors(gdk_display_get_default());
+    if (g_list_model_get_n_items(monitors) == 0) {
+        std::fprintf(stderr, "No monitor\n");
+        return;
+    }
+    auto *monitor = GDK_MONITOR(g_list_model_get_item(monitors, 0));
+
+    // Keeps the application running between one output's window and the next
+    g_application_hold(G_APPLICATION(app));
+    for (const auto& backend : bench->backends) {
+        if (!run_backend(app, monitor, backend, *bench)) bench->failed = true;
+    }
+    g_application_release(G_APPLICATION(app));
+    g_object_unref(monitor);
+}
+
+int main(int argc, char **argv) {
+    if (!g_getenv("WAYLAND_DISPLAY")) {
+        std::fprintf(stderr, "No Wayland compositor, skipping\n");
+        return SKIPPED;
+    }
+
+    Bench bench;
+    for (int i = 1; i < argc; i++) bench.backends.push_back(argv[i]);
+    if (bench.backends.empty()) bench.backends = {"gtk", "wayland", "software"};
+
+    GtkApplication *app = gtk_application_new("com.hyprvidwall.bench", G_APPLICATION_NON_UNIQUE);
+    g_signal_connect(app, "activate", G_CALLBACK(on_activate), &bench);
+    char *app_argv[] = {argv[0], nullptr};
+    g_application_run(G_APPLICATION(app), 1, app_argv);
+    g_object_unref(app);
+
+    if (bench.failed) return 1;
+    return bench.ran > 0 ? 0 : SKIPPED;
+}
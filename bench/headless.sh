@@ -0,0 +1,28 @@
+#!/bin/sh
+# Runs a command against a headless sway (wlroots, so wlr-layer-shell is
+# there) with one 1920x1080 output. Nothing is drawn on a GPU: sway uses
+# pixman and GL clients llvmpipe. Exits 77 (skipped) without sway.
+command -v sway >/dev/null 2>&1 || { echo "sway not found, skipping" >&2; exit 77; }
+
+runtime=$(mktemp -d)
+trap 'kill "$sway_pid" 2>/dev/null; wait "$sway_pid" 2>/dev/null; rm -rf "$runtime"' EXIT
+echo 'output HEADLESS-1 mode 1920x1080@60Hz' > "$runtime/config"
+
+XDG_RUNTIME_DIR="$runtime" WLR_BACKENDS=headless WLR_RENDERER=pixman WLR_LIBINPUT_NO_DEVICES=1 \
+    sway -c "$runtime/config" > "$runtime/sway.log" 2>&1 &
+sway_pid=$!
+
+# The socket shows up once sway is ready
+socket=
+for _ in $(seq 50); do
+    socket=$(cd "$runtime" && ls wayland-* 2>/dev/null | grep -v '\.lock$' | head -n 1)
+    [ -n "$socket" ] && break
+    sleep 0.1
+done
+if [ -z "$socket" ]; then
+    echo "headless sway did not start:" >&2
+    cat "$runtime/sway.log" >&2
+    exit 77
+fi
+
+XDG_RUNTIME_DIR="$runtime" WAYLAND_DISPLAY="$socket" LIBGL_ALWAYS_SOFTWARE=1 "$@"
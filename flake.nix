@@ -22,6 +22,7 @@
             meson
             ninja
             pkg-config
+            wayland-scanner
           ];
 
           buildInputs = with pkgs; [
@@ -29,6 +30,8 @@
             gtk4-layer-shell
             mpv
             libepoxy
+            wayland
+            wayland-protocols
           ];
 
           meta = with pkgs.lib; {
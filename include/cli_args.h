@@ -9,6 +9,24 @@ struct CliArgs {
     bool auto_pause = true;        
     bool no_downscale = false;     
     bool no_hwdec = false;        
+    int coalesce_ms = 50;          // IPC event burst coalescing window
+    bool ipc_main_loop = false;    // Handle IPC on the GTK main loop instead of a thread
+    int occlusion_pct = 95;        // Window coverage (%) at which a monitor counts as hidden
+    int pause_delay_ms = 300;      // Time covered before pausing
+    int resume_delay_ms = 100;     // Time visible before resuming
+    int deep_pause_s = 0;          // Time paused before unloading the video, 0 disables
+    int dpms_poll_s = 5;           // DPMS state (and floating window) poll interval, 0 disables
+    bool optimize = false;         // Transcode into the cache for cheaper decoding if not done yet
+    int preload_mb = 0;            // Hold videos up to this size in memory, 0 disables
+    int frame_cache_mb = 0;        // GPU memory for replaying a loop from rendered frames, 0 disables
+    int fps = 0;                   // Frame cap for decode, render and present, 0 = source rate
+    bool skip_static = false;      // Drop (near-)duplicate frames before rendering
+    bool shared_decoder = false;   // One decoder for all monitors instead of one each
+    bool render_thread = false;    // Render video frames off the main thread
+    double render_scale = 1.0;     // Share of the output size mpv renders at, 0 = auto (source size)
+    bool opaque = false;           // Opaque surface, no blending, damage limited to the video
+    std::string backend = "gtk";   // Surface backend: "gtk", "wayland" (own layer surfaces) or "software"
+    bool stats = false;            // Log render/IPC statistics every 5 seconds
     bool show_help = false;
     
    
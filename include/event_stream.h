@@ -0,0 +1,116 @@
+#pragma once
+#include <string_view>
+#include <cstddef>
+
+// Fixed-capacity ring buffer that frames the Hyprland event socket into
+// lines. Reads go straight into the ring and lines come back as views, so
+// framing never allocates or shifts buffered data.
+class LineRing {
+public:
+    static constexpr size_t CAPACITY = 16384;
+
+    // Contiguous free space for the next read; may be less than the total free space
+    char *write_ptr(size_t& available);
+    void commit(size_t n);
+
+    // Next complete line without its '\n'. The view is valid until the next call.
+    bool next_line(std::string_view& line);
+
+    // True (once) if a line longer than CAPACITY had to be dropped
+    bool take_overflow();
+
+private:
+    char data[CAPACITY];
+    char scratch[CAPACITY];   // reassembly space for lines that wrap around
+    size_t head = 0;          // read position (monotonic, wrapped on access)
+    size_t tail = 0;          // write position (monotonic)
+    size_t scan = 0;          // first byte not yet searched for '\n'
+    bool discarding = false;  // dropping the rest of an oversized line
+    bool overflow = false;
+};
+
+// Hyprland socket2 events vidwall reacts to
+enum class HyprEvent {
+    Unknown,
+    OpenWindow,
+    CloseWindow,
+    MoveWindow,
+    MoveWindowV2,
+    Workspace,
+    WorkspaceV2,
+    FocusedMon,
+    CreateWorkspaceV2,
+    DestroyWorkspaceV2,
+    RenameWorkspace,
+    MoveWorkspace,
+    MoveWorkspaceV2,
+    ActiveSpecial,
+    MonitorAdded,
+    MonitorAddedV2,
+    MonitorRemoved,
+    ChangeFloatingMode,
+    Fullscreen,
+    ConfigReloaded
+};
+
+// Switch on length, then compare: resolves to a handful of instructions per line
+constexpr HyprEvent classify_event(std::string_view name) {
+    switch (name.size()) {
+    case 9:
+        if (name == "workspace") return HyprEvent::Workspace;
+        break;
+    case 10:
+        if (name == "openwindow") return HyprEvent::OpenWindow;
+        if (name == "movewindow") return HyprEvent::MoveWindow;
+        if (name == "focusedmon") return HyprEvent::FocusedMon;
+        if (name == "fullscreen") return HyprEvent::Fullscreen;
+        break;
+    case 11:
+        if (name == "closewindow") return HyprEvent::CloseWindow;
+        if (name == "workspacev2") return HyprEvent::WorkspaceV2;
+        break;
+    case 12:
+        if (name == "movewindowv2") return HyprEvent::MoveWindowV2;
+        if (name == "monitoradded") return HyprEvent::MonitorAdded;
+        break;
+    case 13:
+        if (name == "moveworkspace") return HyprEvent::MoveWorkspace;
+        if (name == "activespecial") return HyprEvent::ActiveSpecial;
+        break;
+    case 14:
+        if (name == "monitoraddedv2") return HyprEvent::MonitorAddedV2;
+        if (name == "monitorremoved") return HyprEvent::MonitorRemoved;
+        if (name == "configreloaded") return HyprEvent::ConfigReloaded;
+        break;
+    case 15:
+        if (name == "renameworkspace") return HyprEvent::RenameWorkspace;
+        if (name == "moveworkspacev2") return HyprEvent::MoveWorkspaceV2;
+        break;
+    case 17:
+        if (name == "createworkspacev2") return HyprEvent::CreateWorkspaceV2;
+        break;
+    case 18:
+        if (name == "destroyworkspacev2") return HyprEvent::DestroyWorkspaceV2;
+        if (name == "changefloatingmode") return HyprEvent::ChangeFloatingMode;
+        break;
+    }
+    return HyprEvent::Unknown;
+}
+
+static_assert(classify_event("openwindow") == HyprEvent::OpenWindow);
+static_assert(classify_event("movewindowv2") == HyprEvent::MoveWindowV2);
+static_assert(classify_event("monitorremoved") == HyprEvent::MonitorRemoved);
+static_assert(classify_event("changefloatingmode") == HyprEvent::ChangeFloatingMode);
+static_assert(classify_event("activewindow") == HyprEvent::Unknown);
+
+// Comma-separated event payload; the last field keeps any remaining commas
+// (window titles)
+struct EventFields {
+    static constexpr size_t MAX_FIELDS = 4;
+
+    std::string_view field[MAX_FIELDS];
+    size_t count = 0;
+
+    EventFields(std::string_view payload, size_t max_fields);
+    std::string_view operator[](size_t i) const { return field[i]; }
+};
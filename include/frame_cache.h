@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// --frame-cache: one loop pass of rendered frames kept as GL textures at
+// the size mpv rendered them, so later passes are blits instead of
+// decoding. All calls need the owning output's GL context current.
+class FrameCache {
+public:
+    explicit FrameCache(size_t budget_bytes) : budget(budget_bytes) {}
+
+    FrameCache(const FrameCache&) = delete;
+    FrameCache& operator=(const FrameCache&) = delete;
+
+    // Framebuffer for the next recorded frame; 0 if it would exceed the
+    // budget or differs in size from the first frame
+    unsigned int add_frame(int width, int height);
+    // Drops recorded frames past count
+    void trim(size_t count);
+    // Blits a frame into the bound framebuffer, scaled to width x height
+    void draw(size_t index, int width, int height) const;
+    void clear();
+
+    size_t size() const { return frames.size(); }
+    size_t bytes() const { return frames.size() * frame_bytes(); }
+
+private:
+    struct Frame {
+        unsigned int texture = 0;
+        unsigned int fbo = 0;
+    };
+
+    size_t budget;
+    int width = 0;
+    int height = 0;
+    std::vector<Frame> frames;
+
+    size_t frame_bytes() const { return static_cast<size_t>(width) * height * 4; }
+};
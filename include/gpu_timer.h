@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+
+// GPU time of a section of GL commands (GL_TIME_ELAPSED queries). A few
+// queries rotate and each result is read once the GPU has it, so timing
+// never waits for the GPU. Desktop GL 3.3 or ARB_timer_query only; all
+// calls except take() need the same GL context current.
+class GpuTimer {
+public:
+    static constexpr int QUERIES = 4;
+
+    void begin();
+    void end();
+    // Per-section times since the previous call; false without timer queries
+    bool take(double& avg_ms, double& max_ms);
+    // Deletes the queries; before the context goes away
+    void release();
+
+private:
+    bool checked = false;
+    bool supported = false;
+    unsigned int queries[QUERIES] = {};
+    bool pending[QUERIES] = {};
+    int next = 0;
+    bool running = false;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t sections = 0;
+
+    void collect();
+};
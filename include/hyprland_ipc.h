@@ -1,28 +1,151 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "event_stream.h"
+#include "visibility.h"
+
+namespace json_scan { struct ClientView; }
 
 class HyprlandIPC {
 public:
-    using FocusCallback = std::function<void(bool has_focus)>;
-    
+    // Reported for every monitor on each evaluation, keyed by Hyprland monitor name
+    using VisibilityCallback = std::function<void(const std::string& monitor, Visibility visibility)>;
+    // A workspace switch just showed an empty workspace; called from event
+    // handling, ahead of the (coalesced) evaluation
+    using PrewarmCallback = std::function<void(const std::string& monitor)>;
+
+    // Counters since the previous take_stats() call
+    struct Stats {
+        uint64_t events = 0;           // relevant events received
+        uint64_t evaluations = 0;      // pause decisions made
+        double avg_latency_ms = 0.0;   // first event -> decision
+        double max_latency_ms = 0.0;
+    };
+
+    // Rectangle in Hyprland layout coordinates
+    struct Rect {
+        int x = 0, y = 0;
+        int width = 0, height = 0;
+    };
+
     HyprlandIPC();
     ~HyprlandIPC();
-    
+
     bool connect();
-    void start_listening(FocusCallback callback);
+    void start_listening(VisibilityCallback callback);
     void stop_listening();
-    bool is_workspace_empty();
-    
+
+    // Main-loop mode: no listener thread, the caller watches event_fd() and
+    // timer_fd() and calls the matching dispatch function when they are
+    // readable. The callback then runs on the caller's thread.
+    void start_attached(VisibilityCallback callback);
+    int event_fd() const { return socket_fd; }
+    int coalesce_timer_fd() const { return timer_fd; }
+    int power_poll_fd() const { return poll_fd; }
+    bool dispatch_socket();    // false once the connection is lost
+    void dispatch_timer();
+    void dispatch_power_poll();
+
+    // Coalescing window behind an evaluated event, 0 evaluates every read
+    void set_coalesce_window(int ms);
+    // DPMS state is not on the event socket and has to be polled, 0 disables
+    void set_power_poll_interval(int seconds);
+    // Share of a monitor windows must cover before its wallpaper counts as hidden
+    void set_occlusion_threshold(int percent);
+    // Must be set before listening starts
+    void set_prewarm_callback(PrewarmCallback callback);
+    Stats take_stats();
+
 private:
+    // Lets the string-keyed maps be queried with string_views from event payloads
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    template <typename T>
+    using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+
+    // Tracked state of a single client window
+    struct WindowInfo {
+        int workspace_id;
+        bool counted;               // false for ignored classes (bars, notification daemons, ...)
+        bool has_geometry = false;  // false until a clients query reported it
+        Rect geometry;
+        bool fullscreen = false;
+        bool floating = false;      // moved and resized by mouse without events
+        bool hidden = false;        // inactive member of a window group
+    };
+
+    struct MonitorInfo {
+        int active_workspace_id;
+        int special_workspace_id;   // 0 when none is shown
+        Rect area;                  // logical size, after scale and transform
+        bool powered;               // false while DPMS has the output off
+    };
+
     int socket_fd;
+    int timer_fd;
+    int coalesce_ms;
+    int poll_fd;
+    int power_poll_s;
+    bool timer_armed;
+    bool needs_update;
+    LineRing event_ring;
+    std::chrono::steady_clock::time_point first_pending_event;
     std::thread listener_thread;
     std::atomic<bool> running;
-    FocusCallback on_focus_change;
-    
+    VisibilityCallback on_visibility_change;
+    PrewarmCallback on_prewarm;
+    double occlusion_threshold;
+
+    std::atomic<uint64_t> stat_events{0};
+    std::atomic<uint64_t> stat_evaluations{0};
+    std::atomic<uint64_t> stat_latency_total_us{0};
+    std::atomic<uint64_t> stat_latency_max_us{0};
+
+    // Window -> workspace index, owned by whichever thread dispatches events
+    StringMap<WindowInfo> windows;                             // address (no 0x) -> info
+    std::unordered_map<int, int> workspace_window_count;       // workspace id -> counted windows
+    StringMap<int> workspace_ids;                              // workspace name -> id
+    StringMap<MonitorInfo> monitors;                           // monitor name -> shown workspaces
+    std::string focused_monitor;
+    bool needs_resync;
+    bool geometry_dirty;    // window rects may have changed since the last clients query
+    bool translucent;       // configured window opacity < 1, the wallpaper shows through
+
     std::string get_socket_path(bool is_event_socket);
+    std::string send_request(const std::string& request);
     std::string send_command(const std::string& cmd);
+    bool send_batch(const std::vector<std::string>& cmds, std::string& response,
+                    std::vector<std::string_view>& replies);
+    void begin(VisibilityCallback callback);
     void listen_events();
+    bool read_events();
+    void mark_pending();
+    void arm_coalesce_timer();
+    void flush_update();
+    void evaluate();
+
+    bool resync();
+    bool refresh_geometry(bool *changed = nullptr);
+    bool floating_window_shown() const;
+    bool poll_power();
+    bool update_geometry(WindowInfo& window, const json_scan::ClientView& client);
+    bool apply_event(std::string_view line);
+    void add_window(std::string_view address, int workspace_id, std::string_view window_class);
+    void remove_window(std::string_view address);
+    void move_window(std::string_view address, int workspace_id);
+    bool lookup_workspace(std::string_view name, int& workspace_id);
+    void set_workspace_name(std::string_view name, int workspace_id);
+    void set_active_workspace(std::string_view monitor, int workspace_id);
+    void notify_prewarm(const std::string& monitor);
+    int monitor_window_count(const MonitorInfo& monitor) const;
+    Visibility monitor_visibility(const MonitorInfo& monitor, double& coverage) const;
 };
@@ -0,0 +1,271 @@
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Minimal zero-copy JSON tokenizer for Hyprland command replies.
+// Walks the input once and hands out string_views into it; nothing is
+// allocated. String views are the raw bytes between the quotes, escape
+// sequences are left untouched.
+class JsonScanner {
+public:
+    enum class Token {
+        ObjectStart,
+        ObjectEnd,
+        ArrayStart,
+        ArrayEnd,
+        Key,
+        String,
+        Scalar,      // number, true, false, null
+        End,
+        Error
+    };
+
+    explicit JsonScanner(std::string_view json);
+
+    Token next();
+
+    // Key name, string contents or scalar literal of the last token
+    std::string_view text() const { return token_text; }
+
+    // Container depth after the last token (0 = top level)
+    int depth() const { return stack_size; }
+
+    // Offset just past the last token
+    size_t offset() const { return pos; }
+
+    // Skips the rest of the container whose start token was just returned,
+    // consuming its matching end token
+    Token skip_container();
+
+private:
+    static constexpr int MAX_DEPTH = 32;
+
+    std::string_view json;
+    size_t pos = 0;
+    std::string_view token_text;
+    bool is_object[MAX_DEPTH] = {};
+    int stack_size = 0;
+    bool expect_key = false;
+
+    Token push(bool object);
+    Token pop(bool object);
+};
+
+namespace json_scan {
+
+// Fields vidwall needs from one entry of j/clients
+struct ClientView {
+    std::string_view address;
+    std::string_view window_class;
+    std::string_view workspace_name;
+    int workspace_id = 0;
+    bool has_workspace = false;
+    int x = 0, y = 0;               // "at", layout coordinates
+    int width = 0, height = 0;      // "size"
+    bool has_geometry = false;
+    bool floating = false;
+    bool fullscreen = false;
+    bool hidden = false;            // inactive member of a window group
+};
+
+// Fields vidwall needs from one entry of j/workspaces
+struct WorkspaceView {
+    std::string_view name;
+    int workspace_id = 0;
+    bool has_id = false;
+};
+
+// Fields vidwall needs from one entry of j/monitors
+struct MonitorView {
+    std::string_view name;
+    int active_workspace_id = 0;
+    int special_workspace_id = 0;   // 0 when no special workspace is shown
+    bool focused = false;
+    int x = 0, y = 0;               // layout coordinates
+    int width = 0, height = 0;      // pixels, before scale and transform
+    double scale = 1.0;
+    int transform = 0;
+    bool dpms_on = true;            // false while the output is powered down
+};
+
+bool parse_int(std::string_view text, int& out);
+bool parse_double(std::string_view text, double& out);
+
+// Finds a member of the top-level object, e.g. "id" in j/activeworkspace
+bool find_member(std::string_view json, std::string_view key, std::string_view& out);
+
+// Splits concatenated JSON values (a [[BATCH]] reply) into one view per value
+bool split_values(std::string_view json, std::vector<std::string_view>& out);
+
+// Calls fn(const ClientView&) for every object of a j/clients array
+template <typename Fn>
+bool for_each_client(std::string_view json, Fn&& fn) {
+    JsonScanner scanner(json);
+    if (scanner.next() != JsonScanner::Token::ArrayStart) return false;
+
+    ClientView client;
+    std::string_view parent;   // key owning the current nested object
+    std::string_view key;
+    std::string_view array;    // "at" or "size" while inside that array
+    int array_index = 0;
+
+    for (;;) {
+        JsonScanner::Token tok = scanner.next();
+        switch (tok) {
+        case JsonScanner::Token::ObjectStart:
+            if (scanner.depth() == 2) {
+                client = ClientView{};
+            } else if (scanner.depth() == 3) {
+                parent = key;
+            } else {
+                scanner.skip_container();
+            }
+            break;
+        case JsonScanner::Token::ObjectEnd:
+            if (scanner.depth() == 1) fn(static_cast<const ClientView&>(client));
+            else if (scanner.depth() == 2) parent = {};
+            break;
+        case JsonScanner::Token::ArrayStart:
+            if (scanner.depth() == 3 && parent.empty() && (key == "at" || key == "size")) {
+                array = key;
+                array_index = 0;
+            } else if (scanner.depth() > 2) {
+                scanner.skip_container();
+            }
+            break;
+        case JsonScanner::Token::Key:
+            key = scanner.text();
+            break;
+        case JsonScanner::Token::String:
+        case JsonScanner::Token::Scalar:
+            if (scanner.depth() == 2) {
+                if (key == "address") client.address = scanner.text();
+                else if (key == "class") client.window_class = scanner.text();
+                else if (key == "floating") client.floating = scanner.text() == "true";
+                else if (key == "hidden") client.hidden = scanner.text() == "true";
+                else if (key == "fullscreen") {
+                    // bool on older compositors, fullscreen mode (0 = none) on newer ones
+                    client.fullscreen = scanner.text() != "false" && scanner.text() != "0";
+                }
+            } else if (scanner.depth() == 3 && !array.empty()) {
+                int value = 0;
+                parse_int(scanner.text(), value);
+                if (array == "at") (array_index == 0 ? client.x : client.y) = value;
+                else (array_index == 0 ? client.width : client.height) = value;
+                array_index++;
+                client.has_geometry = true;
+            } else if (scanner.depth() == 3 && parent == "workspace") {
+                if (key == "id") client.has_workspace = parse_int(scanner.text(), client.workspace_id);
+                else if (key == "name") client.workspace_name = scanner.text();
+            }
+            break;
+        case JsonScanner::Token::ArrayEnd:
+            if (scanner.depth() == 0) return true;
+            if (scanner.depth() == 2) array = {};
+            break;
+        case JsonScanner::Token::End:
+        case JsonScanner::Token::Error:
+            return false;
+        }
+    }
+}
+
+// Calls fn(const WorkspaceView&) for every object of a j/workspaces array
+template <typename Fn>
+bool for_each_workspace(std::string_view json, Fn&& fn) {
+    JsonScanner scanner(json);
+    if (scanner.next() != JsonScanner::Token::ArrayStart) return false;
+
+    WorkspaceView ws;
+    std::string_view key;
+
+    for (;;) {
+        JsonScanner::Token tok = scanner.next();
+        switch (tok) {
+        case JsonScanner::Token::ObjectStart:
+            if (scanner.depth() == 2) ws = WorkspaceView{};
+            else scanner.skip_container();
+            break;
+        case JsonScanner::Token::ObjectEnd:
+            if (scanner.depth() == 1) fn(static_cast<const WorkspaceView&>(ws));
+            break;
+        case JsonScanner::Token::ArrayStart:
+            if (scanner.depth() > 2) scanner.skip_container();
+            break;
+        case JsonScanner::Token::Key:
+            key = scanner.text();
+            break;
+        case JsonScanner::Token::String:
+        case JsonScanner::Token::Scalar:
+            if (scanner.depth() == 2) {
+                if (key == "id") ws.has_id = parse_int(scanner.text(), ws.workspace_id);
+                else if (key == "name") ws.name = scanner.text();
+            }
+            break;
+        case JsonScanner::Token::ArrayEnd:
+            if (scanner.depth() == 0) return true;
+            break;
+        case JsonScanner::Token::End:
+        case JsonScanner::Token::Error:
+            return false;
+        }
+    }
+}
+
+// Calls fn(const MonitorView&) for every object of a j/monitors array
+template <typename Fn>
+bool for_each_monitor(std::string_view json, Fn&& fn) {
+    JsonScanner scanner(json);
+    if (scanner.next() != JsonScanner::Token::ArrayStart) return false;
+
+    MonitorView monitor;
+    std::string_view parent;
+    std::string_view key;
+
+    for (;;) {
+        JsonScanner::Token tok = scanner.next();
+        switch (tok) {
+        case JsonScanner::Token::ObjectStart:
+            if (scanner.depth() == 2) monitor = MonitorView{};
+            else if (scanner.depth() == 3) parent = key;
+            else scanner.skip_container();
+            break;
+        case JsonScanner::Token::ObjectEnd:
+            if (scanner.depth() == 1) fn(static_cast<const MonitorView&>(monitor));
+            else if (scanner.depth() == 2) parent = {};
+            break;
+        case JsonScanner::Token::ArrayStart:
+            if (scanner.depth() > 2) scanner.skip_container();
+            break;
+        case JsonScanner::Token::Key:
+            key = scanner.text();
+            break;
+        case JsonScanner::Token::String:
+        case JsonScanner::Token::Scalar:
+            if (scanner.depth() == 2) {
+                if (key == "name") monitor.name = scanner.text();
+                else if (key == "focused") monitor.focused = scanner.text() == "true";
+                else if (key == "x") parse_int(scanner.text(), monitor.x);
+                else if (key == "y") parse_int(scanner.text(), monitor.y);
+                else if (key == "width") parse_int(scanner.text(), monitor.width);
+                else if (key == "height") parse_int(scanner.text(), monitor.height);
+                else if (key == "scale") parse_double(scanner.text(), monitor.scale);
+                else if (key == "transform") parse_int(scanner.text(), monitor.transform);
+                else if (key == "dpmsStatus") monitor.dpms_on = scanner.text() != "false";
+            } else if (scanner.depth() == 3 && key == "id") {
+                if (parent == "activeWorkspace") parse_int(scanner.text(), monitor.active_workspace_id);
+                else if (parent == "specialWorkspace") parse_int(scanner.text(), monitor.special_workspace_id);
+            }
+            break;
+        case JsonScanner::Token::ArrayEnd:
+            if (scanner.depth() == 0) return true;
+            break;
+        case JsonScanner::Token::End:
+        case JsonScanner::Token::Error:
+            return false;
+        }
+    }
+}
+
+} // namespace json_scan
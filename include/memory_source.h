@@ -0,0 +1,30 @@
+#pragma once
+#include <mpv/client.h>
+#include <cstdint>
+#include <string>
+
+// --preload: the video read into memory once and handed to every mpv
+// instance through a custom protocol, so loop iterations are served with
+// memcpy instead of file reads.
+namespace memory_source {
+
+// Reads the file if it is at most limit_mb; false if it stays on disk
+bool load(const std::string& path, int limit_mb);
+// After every mpv instance using it is gone
+void unload();
+
+// Makes the protocol known to an mpv instance and returns what it should
+// loadfile: the in-memory URI, or path if nothing is loaded or mpv
+// refuses the protocol
+std::string register_protocol(mpv_handle *mpv, const std::string& path);
+
+// Stream callbacks since the previous call
+struct Stats {
+    uint64_t opens = 0;
+    uint64_t reads = 0;
+    uint64_t seeks = 0;
+    uint64_t bytes = 0;
+};
+Stats take_stats();
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <mpv/client.h>
+#include "cli_args.h"
+
+// The hwdec option playback uses
+const char *hwdec_mode(const CliArgs& args);
+
+// Options every mpv instance vidwall creates gets, before mpv_initialize()
+void apply_mpv_options(mpv_handle *mpv, const CliArgs& args);
+
+// Puts the --fps cap in front of the video filters if the source is
+// faster. libavfilter's fps filter duplicates frames of slower sources, so
+// those are left alone; so is a source without a known rate. Call after
+// the file is loaded; true if the filter was added.
+bool apply_fps_cap(mpv_handle *mpv, int fps, double& source_fps);
+
+// With the --fps cap at half the source rate or less, most dropped frames
+// are non-reference (B) frames that the decoder need not decode at all.
+// vd-lavc options only apply to new decoders, so the video is reloaded
+// once. Call after the file is loaded; true if the decoder now skips.
+bool enable_decoder_skip(mpv_handle *mpv, int fps, double& source_fps);
+
+// How video larger than the monitor is brought down to its size
+enum class DownscalePath {
+    None,       // fits already, or --no-downscale
+    Hardware,   // hwdec surfaces scaled by the GPU's video processor (scale_vaapi/cuda/vulkan)
+    Gpu,        // mpv's GPU renderer scales while drawing
+    Software    // mpv's software renderer scales while converting
+};
+
+const char *downscale_path_name(DownscalePath path);
+
+// Fits the video into target_width x target_height pixels, keeping the
+// aspect ratio. Call on the first video reconfig, once hwdec-current is
+// known. Hardware decoded frames are scaled before they leave the
+// decoder's memory when a scaler filter exists for the hwdec; otherwise
+// the renderer does it. fit_width/fit_height get the fitted size, the
+// video size if it fits already.
+DownscalePath apply_downscale(mpv_handle *mpv, const CliArgs& args, int target_width, int target_height,
+                              bool gpu_renderer, int& fit_width, int& fit_height);
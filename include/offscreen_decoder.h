@@ -0,0 +1,159 @@
+#pragma once
+#include <gtk/gtk.h>
+#include <epoxy/gl.h>
+#include <epoxy/egl.h>
+#include <mpv/client.h>
+#include <mpv/render_gl.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cli_args.h"
+#include "mpv_config.h"
+
+class WallpaperOutput;
+
+// An mpv instance that renders into textures instead of a window, feeding
+// all outputs (--shared-decoder) or one (--render-thread). Frames are
+// rendered in a GL context of its own, in the share group GTK creates all
+// of a display's contexts in, and the outputs' GL areas only scale the
+// latest one onto their surfaces. With a render thread, mpv renders there,
+// so a stalled main loop delays when a frame is shown but not the frame;
+// the thread uses a plain EGL context in the same share group, since GDK's
+// contexts are only meant to be current on the main thread.
+class OffscreenDecoder {
+public:
+    // Counters and timings since the previous take_stats() call
+    struct Stats {
+        uint64_t frames = 0;            // rendered by mpv
+        uint64_t superseded = 0;        // replaced before the main thread picked them up
+        uint64_t late_drops = 0;        // dropped by mpv for missing their display time
+        double avg_render_ms = 0.0;     // mpv render call, on the render thread if there is one
+        double max_render_ms = 0.0;
+        double avg_handoff_ms = 0.0;    // frame rendered -> picked up on the main thread
+        double max_handoff_ms = 0.0;
+    };
+
+    static constexpr int SLOTS = 3;     // being rendered, ready, shown
+
+    // The frame an output blits; texture names stay valid while the
+    // generation does not change
+    struct Frame {
+        int slot = -1;
+        GLuint textures[SLOTS] = {};
+        int width = 0;
+        int height = 0;
+        uint64_t generation = 0;
+    };
+
+    // label prefixes log lines, "shared" or the output name
+    OffscreenDecoder(const CliArgs& args, const std::string& label);
+    ~OffscreenDecoder();
+
+    OffscreenDecoder(const OffscreenDecoder&) = delete;
+    OffscreenDecoder& operator=(const OffscreenDecoder&) = delete;
+
+    // Before start(): the first pass begins at seconds, loops from the start
+    void set_start(double seconds) { start_position = seconds; }
+    bool start(GdkDisplay *display, bool render_thread);
+
+    void attach(WallpaperOutput *output);
+    void detach(WallpaperOutput *output);
+    // Visible or prewarming outputs are active; decoding runs while any is
+    void set_active(WallpaperOutput *output, bool active);
+
+    // Main thread, with the output's GL context current: the latest frame,
+    // with the GPU told to wait until it is rendered. False before the first.
+    bool acquire_frame(Frame& frame);
+    // Once the blit is issued; the slot is not rendered into until it completes
+    void release_frame(const Frame& frame);
+
+    // Playback position in seconds, -1 if unknown
+    double position();
+    void get_decode_rates(double& source_fps, double& filtered_fps);
+    bool decoder_skipping() const { return decoder_skip; }
+    DownscalePath downscale_path() const { return downscale; }
+    bool threaded() const { return render_thread.joinable(); }
+    Stats take_stats();
+
+private:
+    CliArgs args;
+    std::string label;
+    std::string video_location;                  // path, or the --preload stream
+    GdkGLContext *gl_context = nullptr;
+    EGLDisplay thread_egl_display = EGL_NO_DISPLAY;   // render thread's context, shares with gl_context
+    EGLContext thread_egl_context = EGL_NO_CONTEXT;
+    EGLenum thread_egl_api = EGL_OPENGL_API;
+    mpv_handle *mpv = nullptr;
+    mpv_render_context *mpv_gl = nullptr;
+    int wakeup_fd = -1;
+    guint wakeup_watch_id = 0;
+    double start_position = -1.0;                // set_start(), cleared after the first pass began
+    bool use_thread = false;
+    std::atomic<bool> update_queued{false};
+    std::atomic<bool> frame_notify_queued{false};
+    std::atomic<bool> running{false};            // some output is active
+
+    // Render thread wakeups
+    std::thread render_thread;
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    bool update_pending = false;
+    bool stopping = false;
+
+    // Frame slots; the producer owns back, the main thread front
+    mutable std::mutex frame_mutex;
+    GLuint textures[SLOTS] = {};
+    GLuint fbos[SLOTS] = {};                     // producer context only
+    GLsync render_fences[SLOTS] = {};
+    std::vector<GLsync> read_fences[SLOTS];      // blits of the slot still in flight
+    int back = 0;
+    int ready = 1;
+    int front = 2;
+    bool ready_fresh = false;
+    bool front_valid = false;
+    std::chrono::steady_clock::time_point ready_time;
+    int width = 0;
+    int height = 0;
+    int requested_width = 0;                     // filtered video size, set on reconfig
+    int requested_height = 0;
+    uint64_t generation = 0;
+    bool has_sync = false;
+
+    std::vector<WallpaperOutput*> outputs;
+    std::vector<WallpaperOutput*> active;
+    int64_t video_width = 0;
+    int64_t video_height = 0;
+    bool decoder_skip_checked = false;
+    bool decoder_skip = false;
+    bool downscale_checked = false;
+    DownscalePath downscale = DownscalePath::None;
+    int downscale_width = 0;                     // frames rendered at most this size, 0 = video size
+    int downscale_height = 0;
+
+    Stats stats;                                 // under frame_mutex
+    uint64_t render_total_us = 0;
+    uint64_t handoff_total_us = 0;
+    uint64_t handoffs = 0;
+    int64_t drop_count_snapshot = 0;
+
+    static void *get_proc_address(void *ctx, const char *name);
+    static void on_mpv_render_update(void *ctx);
+    static void on_mpv_wakeup(void *ctx);
+    static gboolean on_mpv_wakeup_ready(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_render_update_idle(gpointer user_data);
+    static gboolean on_frame_ready_idle(gpointer user_data);
+
+    bool setup_gl_context(GdkDisplay *display);
+    bool setup_thread_context();
+    bool setup_mpv();
+    void handle_mpv_events();
+    void render_loop();
+    void render_update();
+    void notify_outputs();
+    void reallocate_slots();
+    void free_slots();
+};
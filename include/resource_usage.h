@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+
+// Memory and CPU figures for diagnostics
+namespace resource_usage {
+
+// Resident set size of this process in KiB, -1 if unavailable
+int64_t rss_kb();
+
+// Free video memory in KiB from GL_NVX_gpu_memory_info or GL_ATI_meminfo,
+// -1 if the driver offers neither. Needs a current GL context.
+int64_t free_vram_kb();
+
+// CPU time used by all threads of this process in microseconds, including
+// mpv's and the GL driver's (llvmpipe renders on its own threads)
+int64_t cpu_time_us();
+
+// read() family system calls made by this process so far (/proc/self/io
+// syscr), -1 if unavailable
+int64_t read_syscalls();
+
+}
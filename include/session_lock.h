@@ -0,0 +1,42 @@
+#pragma once
+#include <gio/gio.h>
+#include <functional>
+#include <string>
+
+// Follows the logind LockedHint of the session vidwall runs in. Screen
+// lockers (hyprlock, ...) set it while the lock screen is up.
+class SessionLock {
+public:
+    using LockCallback = std::function<void(bool locked)>;
+
+    SessionLock();
+    ~SessionLock();
+
+    SessionLock(const SessionLock&) = delete;
+    SessionLock& operator=(const SessionLock&) = delete;
+
+    // Subscribes on the system bus; false without logind or a session
+    bool start(LockCallback callback);
+    bool locked() const { return is_locked; }
+
+private:
+    GDBusConnection *bus;
+    std::string session_path;
+    guint properties_sub_id;
+    guint unlock_sub_id;
+    bool is_locked;
+    LockCallback on_lock_change;
+
+    bool find_session();
+    bool read_locked_hint(bool& locked);
+    void set_locked(bool locked);
+
+    static void on_properties_changed(GDBusConnection *connection, const gchar *sender,
+                                      const gchar *object_path, const gchar *interface_name,
+                                      const gchar *signal_name, GVariant *parameters,
+                                      gpointer user_data);
+    static void on_unlock(GDBusConnection *connection, const gchar *sender,
+                          const gchar *object_path, const gchar *interface_name,
+                          const gchar *signal_name, GVariant *parameters,
+                          gpointer user_data);
+};
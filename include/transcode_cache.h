@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include "cli_args.h"
+
+// --optimize: the video transcoded once, through libmpv's encoding mode,
+// to the monitors' size in 8-bit 4:2:0, in whichever codec a short probe
+// found cheapest to decode with the hwdec playback uses, and kept in
+// $XDG_CACHE_HOME/vidwall under its content hash, the target parameters and
+// the codec. An index beside the files maps path, size and modification
+// time to the cached copy, so later launches find it without hashing.
+namespace transcode_cache {
+
+// What the cached copy was made for; a different target makes another copy
+struct Target {
+    int width = 0;
+    int height = 0;
+    int fps = 0;          // --fps baked in, 0 keeps the source rate
+    bool audio = false;
+};
+
+// Decode time of the first seconds of a file, flat out through the render
+// API with the hwdec playback uses; < 0 if it could not be measured
+struct DecodeCost {
+    double cpu_ms_per_frame = -1.0;
+    double fps = -1.0;
+};
+
+struct Entry {
+    std::string file;     // the cached copy, empty if there is none
+    DecodeCost source;
+    DecodeCost optimized;
+};
+
+// $XDG_CACHE_HOME/vidwall, ~/.cache/vidwall without it
+std::string cache_dir();
+
+// The cached copy of path for target, if the file is unchanged since it
+// was transcoded
+Entry lookup(const std::string& path, const Target& target);
+
+// Probes the codecs, transcodes path into the cache and measures both
+// files; blocks until done and logs the progress. Needs GDK initialized
+// for the GL context measurements render with. Entry::file is empty on
+// failure.
+Entry create(const std::string& path, const Target& target, const CliArgs& args);
+
+// The copy is only worth playing if it decodes cheaper than the source
+bool worthwhile(const Entry& entry);
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// How much of a monitor's wallpaper is left uncovered by windows
+enum class Visibility {
+    Off,        // output powered down or session locked: stop at once, no prewarm
+    Hidden,     // covered: stop decoding
+    Partial,    // partly covered or behind translucent windows: render at reduced rate
+    Visible     // nothing on top: play normally
+};
+
+constexpr const char *visibility_name(Visibility visibility) {
+    switch (visibility) {
+    case Visibility::Off: return "off";
+    case Visibility::Hidden: return "hidden";
+    case Visibility::Partial: return "partial";
+    case Visibility::Visible: return "visible";
+    }
+    return "unknown";
+}
+
+constexpr bool visibility_paused(Visibility visibility) {
+    return visibility == Visibility::Off || visibility == Visibility::Hidden;
+}
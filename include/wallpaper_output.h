@@ -0,0 +1,254 @@
+#pragma once
+#include <gtk/gtk.h>
+#include <mpv/client.h>
+#include <mpv/render_gl.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "cli_args.h"
+#include "frame_cache.h"
+#include "gpu_timer.h"
+#include "mpv_config.h"
+#include "visibility.h"
+
+class OffscreenDecoder;
+class WaylandConnection;
+class WaylandSurface;
+
+// One layer-shell wallpaper surface bound to a single GdkMonitor, with its
+// own mpv instance so decoding stops for outputs that are covered, or
+// showing the frames of an OffscreenDecoder (shared, or its own with
+// --render-thread).
+class WallpaperOutput {
+public:
+    // Counters since the previous take_transition_stats() call
+    struct TransitionStats {
+        uint64_t avoided = 0;          // pause/resume cancelled inside the hysteresis window
+        uint64_t prewarms = 0;         // decoder started ahead of a reveal
+        uint64_t wasted_prewarms = 0;  // ... and stopped again without one
+        uint64_t reveals = 0;
+        double avg_reveal_ms = 0.0;    // reveal -> first rendered frame
+        double max_reveal_ms = 0.0;
+    };
+
+    // Loop wraps of this output's own mpv since the previous take_loop_stats()
+    struct LoopStats {
+        uint64_t loops = 0;
+        double avg_seam_ms = 0.0;      // last frame before the wrap -> first after it
+        double max_seam_ms = 0.0;
+    };
+
+    // With a shared decoder the output has no mpv of its own; with a
+    // Wayland connection it draws into its own layer surface, not GTK's
+    WallpaperOutput(GtkApplication *app, GdkMonitor *monitor, const CliArgs& args, Visibility initial,
+                    OffscreenDecoder *shared = nullptr, WaylandConnection *wayland = nullptr);
+    ~WallpaperOutput();
+
+    WallpaperOutput(const WallpaperOutput&) = delete;
+    WallpaperOutput& operator=(const WallpaperOutput&) = delete;
+
+    bool start();
+    void pause_video();
+    void resume_video();
+    // Off and hidden pause, partial renders at reduced rate, visible plays
+    // normally. Hiding waits for --pause-delay and resuming for
+    // --resume-delay; a change back within that time cancels the
+    // transition. Off pauses at once.
+    void set_visibility(Visibility visibility);
+    // Unpauses the decoder without rendering, ahead of an expected reveal
+    void prewarm();
+
+    GdkMonitor *get_monitor() const { return monitor; }
+    const std::string& get_name() const { return name; }
+    bool paused() const { return is_paused.load(std::memory_order_relaxed); }
+    bool reduced_rate() const { return is_reduced.load(std::memory_order_relaxed); }
+    // Drawing into its own layer surface; false on GTK's, also after a fallback
+    bool direct_surface() const { return direct != nullptr; }
+    uint64_t take_render_count();
+    uint64_t take_present_count();
+    // Source frame rate and rate leaving the filter chain (after --fps decimation)
+    void get_decode_rates(double& source_fps, double& filtered_fps);
+    bool decoder_skipping() const;
+    // --skip-static: share of frames dropped in the last complete loop pass, < 0 before one
+    double skipped_fraction() const { return last_skip_fraction; }
+    TransitionStats take_transition_stats();
+    LoopStats take_loop_stats();
+    // CPU time of the render call per frame since the previous call
+    void take_render_time(double& avg_ms, double& max_ms);
+    // GPU time per rendered frame; false if the driver cannot measure it
+    bool take_gpu_time(double& avg_ms, double& max_ms) { return gpu_timer.take(avg_ms, max_ms); }
+    DownscalePath downscale_path() const { return downscale; }
+    // Monitor size in physical pixels, what the video is downscaled to
+    void monitor_pixel_size(int& width, int& height) const;
+    // --frame-cache: "off", "recording", "playing" (mpv paused) or "waiting" for a loop start
+    const char *frame_cache_state() const;
+    size_t frame_cache_frames() const { return frame_cache ? frame_cache->size() : 0; }
+    size_t frame_cache_bytes() const { return frame_cache ? frame_cache->bytes() : 0; }
+    // Own --render-thread decoder, nullptr when rendering directly or shared
+    OffscreenDecoder *own_decoder() const { return own_offscreen.get(); }
+
+    // Called by the offscreen decoder
+    void set_video_size(int64_t video_width, int64_t video_height);
+    void offscreen_frame_ready();
+
+private:
+    static constexpr int64_t REDUCED_FRAME_INTERVAL_US = 33333;  // ~30 FPS while partly covered
+    static constexpr guint PREWARM_TIMEOUT_MS = 1000;        // on top of --resume-delay
+
+    GtkApplication *app;
+    GdkMonitor *monitor;
+    std::string name;         // connector, matches the Hyprland monitor name
+    CliArgs args;
+    GtkWindow *window;
+    GtkWidget *gl_area;
+    mpv_handle *mpv;
+    mpv_render_context *mpv_gl;
+    std::string video_location;               // path, or the --preload stream
+    OffscreenDecoder *offscreen;              // frames come from here instead of mpv_gl
+    std::unique_ptr<OffscreenDecoder> own_offscreen;   // --render-thread without --shared-decoder
+    WaylandConnection *wayland;               // --backend wayland or software
+    std::unique_ptr<WaylandSurface> direct;   // set when the direct surface could be created
+    unsigned int offscreen_read_fbo[3] = {};  // per-context FBOs around the decoder's textures
+    uint64_t offscreen_generation = 0;
+    guint pending_resize_id;
+    std::atomic<bool> is_paused;
+    std::atomic<bool> is_reduced;
+    std::atomic<bool> update_queued{false};   // an idle callback will pull mpv's update
+    int wakeup_fd = -1;                       // eventfd signalled by mpv's wakeup callback
+    guint wakeup_watch_id = 0;
+    GdkFrameClock *frame_clock = nullptr;
+    gulong after_paint_id = 0;
+    bool swap_pending = false;                // rendered this frame, report the swap to mpv
+    std::chrono::steady_clock::time_point last_frame_render;
+    int64_t last_video_width = 0;
+    int64_t last_video_height = 0;
+    std::atomic<uint64_t> render_count{0};
+    std::atomic<uint64_t> render_count_snapshot{0};
+    uint64_t present_count = 0;
+    bool decoder_skip_checked = false;
+    bool decoder_skip = false;                // vd-lavc-skipframe=nonref active
+    bool downscale_checked = false;
+    DownscalePath downscale = DownscalePath::None;
+    uint64_t render_time_total_us = 0;
+    uint64_t render_time_max_us = 0;
+    uint64_t render_time_frames = 0;
+    bool loop_restart = false;                // the next frame is the first after a wrap
+    uint64_t loops = 0;
+    uint64_t seam_total_us = 0;
+    uint64_t seam_max_us = 0;
+    GpuTimer gpu_timer;
+
+    // --render-scale: mpv renders here, one linear blit stretches it onto the surface
+    unsigned int scaled_fbo = 0;
+    unsigned int scaled_texture = 0;
+    int scaled_width = 0;
+    int scaled_height = 0;
+
+    // --frame-cache: the first complete loop pass is recorded, later passes
+    // are replayed from it on a timer while mpv stays paused
+    std::unique_ptr<FrameCache> frame_cache;
+    bool cache_recording = false;
+    bool cache_playing = false;
+    int64_t cache_drops_start = 0;            // mpv's dropped frames when recording started
+    int64_t cache_last_frame = -1;            // mpv's frame number recorded last
+    double cache_frame_s = 0.0;               // duration of one cached frame
+    int cache_width = 0;                      // surface size the frames were recorded for
+    int cache_height = 0;
+    guint cache_tick_id = 0;
+    std::chrono::steady_clock::time_point cache_epoch;   // when frame 0 of the replay was due
+    size_t cache_index = 0;                   // frame shown last
+
+    // --skip-static accounting per loop pass
+    uint64_t pass_frames = 0;                 // frames that left the filter chain
+    bool pass_started = false;
+    bool pass_interrupted = false;            // paused during the pass, counts are partial
+    double last_skip_fraction = -1.0;
+    uint64_t present_count_snapshot = 0;
+
+    // Visibility state machine, main thread only
+    Visibility applied;                 // what playback currently reflects
+    Visibility target;                  // latest decision, applied when the timer fires
+    guint transition_timer_id = 0;
+    guint prewarm_timer_id = 0;
+    bool prewarming = false;
+    bool reveal_pending = false;
+    std::chrono::steady_clock::time_point reveal_start;
+    TransitionStats transition_stats;
+    uint64_t reveal_total_us = 0;
+
+    // --deep-pause-after: decoder and render context released, the last
+    // frame kept in a texture for redraws
+    guint deep_pause_timer_id = 0;
+    guint deep_pause_report_id = 0;
+    bool deep_paused = false;
+    bool reload_pending = false;              // showing the snapshot until the reloaded file renders
+    double resume_position = -1.0;            // playback position when the file was unloaded
+    bool restore_start = false;               // "start" was pointed at resume_position for the reload
+    std::string saved_start;
+    unsigned int snapshot_fbo = 0;
+    unsigned int snapshot_texture = 0;
+    int snapshot_width = 0;
+    int snapshot_height = 0;
+    int64_t rss_before_kb = -1;
+    int64_t vram_before_kb = -1;
+
+    static void *get_proc_address(void *ctx, const char *name);
+    static void on_mpv_render_update(void *ctx);
+    static void on_mpv_wakeup(void *ctx);
+    static gboolean on_mpv_wakeup_ready(gint fd, GIOCondition condition, gpointer user_data);
+    static gboolean on_render_update_idle(gpointer user_data);
+    static void on_after_paint(GdkFrameClock *clock, gpointer user_data);
+    static gboolean on_transition_timer(gpointer user_data);
+    static gboolean on_prewarm_timeout(gpointer user_data);
+    static gboolean on_deep_pause_timer(gpointer user_data);
+    static gboolean on_deep_pause_report(gpointer user_data);
+    static gboolean on_cache_tick(gpointer user_data);
+    static void on_gl_realize(GtkGLArea *area, gpointer user_data);
+    static gboolean on_gl_render(GtkGLArea *area, GdkGLContext *context, gpointer user_data);
+    static void on_gl_unrealize(GtkGLArea *area, gpointer user_data);
+
+    void setup_window();
+    void setup_mpv();
+    void handle_mpv_events();
+    void setup_rendering();
+    void setup_gl_rendering();
+    void setup_sw_rendering();
+    bool software_rendering() const;
+    void load_video();
+    void queue_frame();
+    void request_render();
+    bool make_current();
+    void surface_size(int& width, int& height) const;
+    void on_presented();
+    bool draw(int width, int height, void *pixels = nullptr, size_t stride = 0);
+    void draw_mpv_frame(int width, int height);
+    void draw_sw_frame(int width, int height, void *pixels, size_t stride);
+    double render_scale(int width, int height) const;
+    bool ensure_scaled_fbo(int width, int height);
+    void free_scaled_fbo();
+    bool draw_offscreen_frame(int width, int height);
+    void free_offscreen_fbos();
+    void set_reduced_rate(bool reduced);
+    int64_t min_frame_interval_us() const;
+    void finish_pass();
+    void apply_visibility(Visibility visibility);
+    void end_prewarm();
+    void note_reveal();
+    void schedule_deep_pause();
+    void enter_deep_pause();
+    void enter_offscreen_deep_pause();
+    void leave_deep_pause();
+    bool take_snapshot();
+    void draw_snapshot(int width, int height);
+    void free_snapshot();
+    void setup_frame_cache();
+    void on_loop_start();
+    void finish_cache_recording();
+    void abandon_cache_recording(const char *reason);
+    void start_cache_tick();
+    void stop_cache_tick();
+    void drop_frame_cache();
+    size_t cache_frame_at(std::chrono::steady_clock::time_point now) const;
+    void adjust_window_for_aspect_ratio(int64_t video_width, int64_t video_height);
+};
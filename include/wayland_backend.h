@@ -0,0 +1,199 @@
+#pragma once
+#include <gtk/gtk.h>
+#include <wayland-client.h>
+#include <wayland-egl.h>
+#include <epoxy/egl.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct zwlr_layer_shell_v1;
+struct zwlr_layer_surface_v1;
+
+// vidwall's own Wayland connection for --backend wayland and software.
+// Each output gets a layer surface with an EGL window, or shm buffers for
+// mpv's software renderer, and mpv renders straight into the buffer the
+// compositor shows, instead of into a GtkGLArea FBO that GTK then copies
+// into its window buffer.
+class WaylandConnection {
+public:
+    WaylandConnection() = default;
+    ~WaylandConnection();
+
+    WaylandConnection(const WaylandConnection&) = delete;
+    WaylandConnection& operator=(const WaylandConnection&) = delete;
+
+    // Binds the globals and, unless drawing in software, sets up EGL;
+    // false if anything is missing
+    bool connect(bool egl);
+
+    wl_display *get_display() const { return display; }
+    wl_compositor *get_compositor() const { return compositor; }
+    zwlr_layer_shell_v1 *get_layer_shell() const { return layer_shell; }
+    wl_shm *get_shm() const { return shm; }
+    EGLDisplay get_egl_display() const { return egl_display; }
+    EGLConfig get_egl_config() const { return egl_config; }
+    EGLenum get_egl_api() const { return egl_api; }
+    // EGL_KHR/EXT_swap_buffers_with_damage
+    bool can_swap_with_damage() const { return swap_with_damage_khr || swap_with_damage_ext; }
+    void swap_buffers(EGLSurface surface, EGLint *rects, EGLint count) const;
+
+    // wl_output for a connector name (wl_output v4), nullptr if unknown
+    wl_output *find_output(const std::string& name, int32_t& scale) const;
+
+    // Handles events EGL read off the socket while swapping
+    void dispatch_pending();
+
+private:
+    struct Output {
+        wl_output *output;
+        uint32_t global;
+        std::string name;
+        int32_t scale = 1;
+    };
+
+    wl_display *display = nullptr;
+    wl_registry *registry = nullptr;
+    wl_compositor *compositor = nullptr;
+    zwlr_layer_shell_v1 *layer_shell = nullptr;
+    uint32_t layer_shell_version = 0;
+    wl_shm *shm = nullptr;
+    std::vector<std::unique_ptr<Output>> outputs;
+    EGLDisplay egl_display = EGL_NO_DISPLAY;
+    EGLConfig egl_config = nullptr;
+    EGLenum egl_api = EGL_OPENGL_API;
+    bool swap_with_damage_khr = false;
+    bool swap_with_damage_ext = false;
+    guint watch_id = 0;
+
+    static const wl_registry_listener registry_listener;
+    static const wl_output_listener output_listener;
+
+    static void on_global(void *data, wl_registry *registry, uint32_t name, const char *interface, uint32_t version);
+    static void on_global_remove(void *data, wl_registry *registry, uint32_t name);
+    static void on_output_geometry(void *data, wl_output *output, int32_t x, int32_t y, int32_t width_mm,
+                                   int32_t height_mm, int32_t subpixel, const char *make, const char *model,
+                                   int32_t transform);
+    static void on_output_mode(void *data, wl_output *output, uint32_t flags, int32_t width, int32_t height,
+                               int32_t refresh);
+    static void on_output_done(void *data, wl_output *output);
+    static void on_output_scale(void *data, wl_output *output, int32_t factor);
+    static void on_output_name(void *data, wl_output *output, const char *name);
+    static void on_output_description(void *data, wl_output *output, const char *description);
+    static gboolean on_display_readable(gint fd, GIOCondition condition, gpointer user_data);
+
+    bool setup_egl();
+};
+
+// A background layer surface on one output with its own EGL window
+// surface and context, or in software mode a small set of XRGB8888 shm
+// buffers at the output's native size. Frames are drawn when the owner
+// asks for one and the compositor's previous frame callback has fired.
+class WaylandSurface {
+public:
+    struct Rect {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+
+        bool operator==(const Rect&) const = default;
+    };
+
+    // Where a frame goes: the default framebuffer of the current EGL
+    // surface, or the mapped pixels of a free shm buffer. content is the
+    // part the video covers (top-left origin), the whole buffer unless
+    // the surface is opaque and knows the video size.
+    struct Target {
+        int width;
+        int height;
+        void *pixels = nullptr;
+        size_t stride = 0;
+        Rect content;
+    };
+    // True if a frame was drawn into the target and should be presented
+    using DrawCallback = std::function<bool(const Target& target)>;
+    // The frame was handed to the compositor
+    using PresentCallback = std::function<void()>;
+
+    WaylandSurface(WaylandConnection& connection, const std::string& output_name, bool software,
+                   DrawCallback draw, PresentCallback presented);
+    ~WaylandSurface();
+
+    WaylandSurface(const WaylandSurface&) = delete;
+    WaylandSurface& operator=(const WaylandSurface&) = delete;
+
+    // Maps the surface and waits for its first configure
+    bool create();
+    // EGL only; software surfaces have no GL context
+    bool make_current();
+    bool software() const { return software_buffers; }
+    void queue_render();
+    // Centered at this logical size; 0 stretches along that axis
+    void set_size(int width, int height);
+    // Declares the surface opaque and limits damage to the video's part
+    // of the buffer; letterbox bars are left as drawn. Before create().
+    void set_opaque(bool opaque) { opaque_content = opaque; }
+    void set_video_size(int64_t video_width, int64_t video_height);
+
+    int get_buffer_width() const { return width * scale; }
+    int get_buffer_height() const { return height * scale; }
+
+private:
+    // Two buffers normally; a third only while the compositor holds both
+    static constexpr int MAX_SHM_BUFFERS = 3;
+
+    struct ShmBuffer {
+        WaylandSurface *owner = nullptr;
+        wl_buffer *buffer = nullptr;
+        void *data = nullptr;
+        size_t size = 0;
+        int width = 0;
+        int height = 0;
+        size_t stride = 0;
+        bool busy = false;    // attached, until the compositor releases it
+        Rect content;         // where video was drawn; the rest is black
+    };
+
+    WaylandConnection& connection;
+    std::string output_name;
+    bool software_buffers;
+    DrawCallback draw;
+    PresentCallback presented;
+    wl_surface *surface = nullptr;
+    zwlr_layer_surface_v1 *layer_surface = nullptr;
+    wl_egl_window *egl_window = nullptr;
+    EGLContext egl_context = EGL_NO_CONTEXT;
+    EGLSurface egl_surface = EGL_NO_SURFACE;
+    ShmBuffer shm_buffers[MAX_SHM_BUFFERS];
+    wl_callback *frame_callback = nullptr;
+    guint render_idle_id = 0;
+    int32_t scale = 1;
+    int width = 0;            // logical, from the last configure
+    int height = 0;
+    bool configured = false;
+    bool closed = false;
+    bool render_requested = false;
+    bool opaque_content = false;
+    int64_t video_width = 0;
+    int64_t video_height = 0;
+    Rect last_content;        // damaged in full when it changes
+    bool full_damage = true;
+
+    static void on_configure(void *data, zwlr_layer_surface_v1 *layer_surface, uint32_t serial,
+                             uint32_t width, uint32_t height);
+    static void on_closed(void *data, zwlr_layer_surface_v1 *layer_surface);
+    static void on_frame_done(void *data, wl_callback *callback, uint32_t time);
+    static gboolean on_render_idle(gpointer user_data);
+    static void on_buffer_release(void *data, wl_buffer *buffer);
+
+    bool setup_egl();
+    Rect content_rect(int buffer_width, int buffer_height) const;
+    void set_opaque_region();
+    void commit_damage(const Target& target);
+    ShmBuffer *acquire_shm_buffer(int buffer_width, int buffer_height);
+    bool allocate_shm_buffer(ShmBuffer& shm_buffer, int buffer_width, int buffer_height);
+    static void free_shm_buffer(ShmBuffer& shm_buffer);
+    void render();
+};
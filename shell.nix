@@ -10,6 +10,9 @@ pkgs.mkShell {
     gtk4-layer-shell
     mpv
     libepoxy 
+    wayland
+    wayland-protocols
+    wayland-scanner
     gdb
     clang-tools
     
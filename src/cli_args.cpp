@@ -1,8 +1,28 @@
 #include "../include/cli_args.h"
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
 #include <unistd.h>
 
+// Reads the integer value following option argv[i], advancing i
+static bool parse_int_value(int argc, char** argv, int& i, int& out) {
+    if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << argv[i] << std::endl;
+        return false;
+    }
+
+    char* end = nullptr;
+    long value = std::strtol(argv[i + 1], &end, 10);
+    if (end == argv[i + 1] || *end != '\0' || value < 0) {
+        std::cerr << "Invalid value for " << argv[i] << ": " << argv[i + 1] << std::endl;
+        return false;
+    }
+
+    out = (int)value;
+    i++;
+    return true;
+}
+
 CliArgs CliArgs::parse(int argc, char** argv) {
     CliArgs args;
     
@@ -32,6 +52,118 @@ CliArgs CliArgs::parse(int argc, char** argv) {
         else if (arg == "--no-hwdec" || arg == "-H") {
             args.no_hwdec = true;
         }
+        else if (arg == "--coalesce-ms" || arg == "-c") {
+            if (!parse_int_value(argc, argv, i, args.coalesce_ms)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--ipc-main-loop" || arg == "-M") {
+            args.ipc_main_loop = true;
+        }
+        else if (arg == "--pause-delay" || arg == "-P") {
+            if (!parse_int_value(argc, argv, i, args.pause_delay_ms)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--resume-delay" || arg == "-R") {
+            if (!parse_int_value(argc, argv, i, args.resume_delay_ms)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--deep-pause-after" || arg == "-d") {
+            if (!parse_int_value(argc, argv, i, args.deep_pause_s)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--dpms-poll" || arg == "-D") {
+            if (!parse_int_value(argc, argv, i, args.dpms_poll_s)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--optimize" || arg == "-z") {
+            args.optimize = true;
+        }
+        else if (arg == "--preload" || arg == "-L") {
+            if (!parse_int_value(argc, argv, i, args.preload_mb)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--frame-cache" || arg == "-C") {
+            if (!parse_int_value(argc, argv, i, args.frame_cache_mb)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--fps" || arg == "-f") {
+            if (!parse_int_value(argc, argv, i, args.fps)) {
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--skip-static" || arg == "-S") {
+            args.skip_static = true;
+        }
+        else if (arg == "--shared-decoder" || arg == "-x") {
+            args.shared_decoder = true;
+        }
+        else if (arg == "--render-thread" || arg == "-T") {
+            args.render_thread = true;
+        }
+        else if (arg == "--render-scale" || arg == "-r") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                args.show_help = true;
+                return args;
+            }
+            std::string value = argv[++i];
+            if (value == "auto") {
+                args.render_scale = 0.0;
+            } else {
+                char* end = nullptr;
+                args.render_scale = std::strtod(value.c_str(), &end);
+                if (end == value.c_str() || *end != '\0' || args.render_scale < 0.1 || args.render_scale > 1.0) {
+                    std::cerr << "Invalid value for " << arg << ": must be 0.1-1.0 or auto" << std::endl;
+                    args.show_help = true;
+                    return args;
+                }
+            }
+        }
+        else if (arg == "--opaque" || arg == "-o") {
+            args.opaque = true;
+        }
+        else if (arg == "--backend" || arg == "-b") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << std::endl;
+                args.show_help = true;
+                return args;
+            }
+            args.backend = argv[++i];
+            if (args.backend != "gtk" && args.backend != "wayland" && args.backend != "software") {
+                std::cerr << "Invalid value for " << arg << ": must be gtk, wayland or software" << std::endl;
+                args.show_help = true;
+                return args;
+            }
+        }
+        else if (arg == "--stats" || arg == "-s") {
+            args.stats = true;
+        }
+        else if (arg == "--occlusion" || arg == "-O") {
+            if (!parse_int_value(argc, argv, i, args.occlusion_pct)) {
+                args.show_help = true;
+                return args;
+            }
+            if (args.occlusion_pct > 100) {
+                std::cerr << "Invalid value for " << arg << ": must be 0-100" << std::endl;
+                args.show_help = true;
+                return args;
+            }
+        }
         else if (arg[0] == '-') {
             std::cerr << "Unknown option: " << arg << std::endl;
             std::cerr << "Use --help for usage information" << std::endl;
@@ -61,9 +193,31 @@ void CliArgs::print_help(const char* program_name) {
     std::cout << "  -m, --mute        Mute audio (default: on)\n";
     std::cout << "  -u, --no-mute     Enable audio\n";
     std::cout << "  -l, --no-loop     Don't loop the video\n";
-    std::cout << "  -p, --no-pause    Disable auto-pause on window focus\n";
-    std::cout << "  -n, --no-downscale Disable 4K downscaling (higher quality, more CPU)\n";
+    std::cout << "  -p, --no-pause    Disable auto-pause when windows cover the wallpaper\n";
+    std::cout << "  -n, --no-downscale Don't downscale videos larger than the monitor before rendering\n";
     std::cout << "  -H, --no-hwdec    Disable hardware decoding (use if crashing)\n";
+    std::cout << "  -c, --coalesce-ms <ms> Window for coalescing bursts of Hyprland events (default: 50)\n";
+    std::cout << "  -M, --ipc-main-loop Handle Hyprland events on the main loop (no listener thread)\n";
+    std::cout << "  -O, --occlusion <pct> Window coverage that pauses a monitor (default: 95)\n";
+    std::cout << "  -P, --pause-delay <ms> Time a monitor must stay covered before pausing (default: 300)\n";
+    std::cout << "  -R, --resume-delay <ms> Time a monitor must stay visible before resuming (default: 100)\n";
+    std::cout << "  -d, --deep-pause-after <s> Unload the video after s seconds paused, 0 disables (default: 0)\n";
+    std::cout << "  -z, --optimize    Transcode the video for this machine's monitors and decoder once,\n";
+    std::cout << "                    then play the cached copy (also on later launches)\n";
+    std::cout << "  -L, --preload <MB> Play from memory if the video is at most MB in size, 0 disables (default: 0)\n";
+    std::cout << "  -C, --frame-cache <MB> Replay loops from up to MB of rendered frames, 0 disables (default: 0);\n";
+    std::cout << "                    frames are uncompressed: 1 s of 4K60 needs about 1900 MB\n";
+    std::cout << "  -f, --fps <n>     Cap decoding, rendering and presenting at n frames per second\n";
+    std::cout << "  -S, --skip-static Don't render frames that barely differ from the previous one\n";
+    std::cout << "  -x, --shared-decoder Decode once and show the frames on every monitor\n";
+    std::cout << "  -T, --render-thread Render video frames on a separate thread\n";
+    std::cout << "  -r, --render-scale <f|auto> Render at this share of the monitor size and upscale;\n";
+    std::cout << "                    auto renders at most at the video's size (default: 1.0)\n";
+    std::cout << "  -o, --opaque      Treat the video as opaque: no blending, only the video area redrawn\n";
+    std::cout << "  -b, --backend <gtk|wayland|software> Draw through GTK, own Wayland layer surfaces,\n";
+    std::cout << "                    or those with mpv's CPU renderer and no GPU (default: gtk)\n";
+    std::cout << "  -s, --stats       Log render and IPC statistics every 5 seconds\n";
+    std::cout << "  -D, --dpms-poll <s> Interval for checking if monitors are powered off, 0 disables (default: 5)\n";
     std::cout << "\n";
     std::cout << "Examples:\n";
     std::cout << "  " << program_name << " video.mp4\n";
@@ -72,8 +226,8 @@ void CliArgs::print_help(const char* program_name) {
     std::cout << "\n";
     std::cout << "Features:\n";
     std::cout << "  • Hardware-accelerated playback\n";
-    std::cout << "  • Automatic 4K downscaling for performance\n";
-    std::cout << "  • Auto-pause when windows are focused (Hyprland)\n";
+    std::cout << "  • Downscaling to the monitor's resolution on the GPU\n";
+    std::cout << "  • Auto-pause when windows cover the wallpaper (Hyprland)\n";
     std::cout << "  • Runs on background layer (behind all windows)\n";
     std::cout << "\n";
 }
@@ -0,0 +1,83 @@
+#include "../include/event_stream.h"
+#include <cstring>
+
+char *LineRing::write_ptr(size_t& available) {
+    size_t used = tail - head;
+    size_t offset = tail % CAPACITY;
+    available = CAPACITY - used;
+    if (available > CAPACITY - offset) {
+        available = CAPACITY - offset;
+    }
+    return data + offset;
+}
+
+void LineRing::commit(size_t n) {
+    tail += n;
+}
+
+bool LineRing::next_line(std::string_view& line) {
+    for (;;) {
+        // Search the unscanned bytes, at most two contiguous segments
+        size_t newline = tail;
+        while (scan < tail) {
+            size_t offset = scan % CAPACITY;
+            size_t len = tail - scan;
+            if (len > CAPACITY - offset) len = CAPACITY - offset;
+
+            const void *hit = memchr(data + offset, '\n', len);
+            if (hit) {
+                newline = scan + (static_cast<const char*>(hit) - (data + offset));
+                break;
+            }
+            scan += len;
+        }
+
+        if (newline == tail) {
+            // No complete line; a full ring means the line can never fit
+            if (tail - head == CAPACITY) {
+                head = scan = tail;
+                discarding = true;
+                overflow = true;
+            }
+            return false;
+        }
+
+        size_t start = head;
+        size_t len = newline - head;
+        head = scan = newline + 1;
+
+        if (discarding) {
+            discarding = false;
+            continue;
+        }
+
+        size_t offset = start % CAPACITY;
+        if (offset + len <= CAPACITY) {
+            line = std::string_view(data + offset, len);
+        } else {
+            size_t first = CAPACITY - offset;
+            memcpy(scratch, data + offset, first);
+            memcpy(scratch + first, data, len - first);
+            line = std::string_view(scratch, len);
+        }
+        return true;
+    }
+}
+
+bool LineRing::take_overflow() {
+    bool result = overflow;
+    overflow = false;
+    return result;
+}
+
+EventFields::EventFields(std::string_view payload, size_t max_fields) {
+    if (max_fields > MAX_FIELDS) max_fields = MAX_FIELDS;
+
+    while (count + 1 < max_fields) {
+        size_t comma = payload.find(',');
+        if (comma == std::string_view::npos) break;
+        field[count++] = payload.substr(0, comma);
+        payload.remove_prefix(comma + 1);
+    }
+    field[count++] = payload;
+}
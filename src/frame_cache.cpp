@@ -0,0 +1,64 @@
+#include "../include/frame_cache.h"
+#include <epoxy/gl.h>
+
+unsigned int FrameCache::add_frame(int frame_width, int frame_height) {
+    if (frames.empty()) {
+        width = frame_width;
+        height = frame_height;
+    }
+    if (frame_width != width || frame_height != height) return 0;
+    if (bytes() + frame_bytes() > budget) return 0;
+
+    GLint previous_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+
+    Frame frame;
+    glGenTextures(1, &frame.texture);
+    glBindTexture(GL_TEXTURE_2D, frame.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &frame.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, frame.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame.texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+
+    // Out of video memory shows up here as well
+    if (!complete) {
+        glDeleteFramebuffers(1, &frame.fbo);
+        glDeleteTextures(1, &frame.texture);
+        return 0;
+    }
+
+    frames.push_back(frame);
+    return frame.fbo;
+}
+
+void FrameCache::trim(size_t count) {
+    while (frames.size() > count) {
+        glDeleteFramebuffers(1, &frames.back().fbo);
+        glDeleteTextures(1, &frames.back().texture);
+        frames.pop_back();
+    }
+}
+
+void FrameCache::draw(size_t index, int target_width, int target_height) const {
+    if (index >= frames.size()) return;
+
+    GLint target_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, frames[index].fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, target_width, target_height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+}
+
+void FrameCache::clear() {
+    trim(0);
+    width = height = 0;
+}
@@ -0,0 +1,68 @@
+#include "../include/gpu_timer.h"
+#include <epoxy/gl.h>
+#include <algorithm>
+
+void GpuTimer::begin() {
+    if (!checked) {
+        checked = true;
+        supported = epoxy_is_desktop_gl() &&
+                    (epoxy_gl_version() >= 33 || epoxy_has_gl_extension("GL_ARB_timer_query"));
+        if (supported) glGenQueries(QUERIES, queries);
+    }
+    if (!supported || running) return;
+
+    collect();
+    // Every query still in flight: skip this section rather than wait
+    if (pending[next]) return;
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    running = true;
+}
+
+void GpuTimer::end() {
+    if (!running) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % QUERIES;
+    running = false;
+}
+
+// Oldest first, stopping at the first result the GPU has not written yet
+void GpuTimer::collect() {
+    for (int i = 0; i < QUERIES; i++) {
+        int slot = (next + i) % QUERIES;
+        if (!pending[slot]) continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+        pending[slot] = false;
+        total_ns += ns;
+        max_ns = std::max<uint64_t>(max_ns, ns);
+        sections++;
+    }
+}
+
+bool GpuTimer::take(double& avg_ms, double& max_ms) {
+    avg_ms = sections > 0 ? total_ns / 1e6 / sections : 0.0;
+    max_ms = max_ns / 1e6;
+    total_ns = 0;
+    max_ns = 0;
+    sections = 0;
+    return supported;
+}
+
+void GpuTimer::release() {
+    if (running) end();
+    if (supported && queries[0]) glDeleteQueries(QUERIES, queries);
+    for (int i = 0; i < QUERIES; i++) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+    next = 0;
+    checked = false;
+    supported = false;
+}
@@ -1,14 +1,22 @@
 #include "../include/hyprland_ipc.h"
+#include "../include/json_scan.h"
 #include <iostream>
 #include <cstring>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <cerrno>
 #include <vector>
-#include <sstream>
 #include <algorithm>
 
-HyprlandIPC::HyprlandIPC() : socket_fd(-1), running(false) {}
+HyprlandIPC::HyprlandIPC()
+    : socket_fd(-1), timer_fd(-1), coalesce_ms(50), poll_fd(-1), power_poll_s(5),
+      timer_armed(false), needs_update(false),
+      running(false), occlusion_threshold(0.95), needs_resync(true), geometry_dirty(false),
+      translucent(false) {}
 
 HyprlandIPC::~HyprlandIPC() {
     stop_listening();
@@ -65,6 +73,44 @@ bool HyprlandIPC::connect() {
 }
 
 std::string HyprlandIPC::send_command(const std::string& cmd) {
+    return send_request("j/" + cmd);
+}
+
+// Sends several queries as one [[BATCH]] request (one connect/write/read cycle)
+// and splits the concatenated reply into one JSON value per command.
+// Falls back to sequential queries if the reply cannot be split.
+bool HyprlandIPC::send_batch(const std::vector<std::string>& cmds, std::string& response,
+                             std::vector<std::string_view>& replies) {
+    std::string request = "[[BATCH]]";
+    for (size_t i = 0; i < cmds.size(); i++) {
+        if (i > 0) request += ';';
+        request += "j/" + cmds[i];
+    }
+
+    replies.clear();
+    response = send_request(request);
+    if (json_scan::split_values(response, replies) && replies.size() == cmds.size()) {
+        return true;
+    }
+
+    // Compositor without batch support: query one by one
+    std::vector<size_t> offsets;
+    response.clear();
+    replies.clear();
+    for (const auto& cmd : cmds) {
+        std::string reply = send_command(cmd);
+        if (reply.empty()) return false;
+        offsets.push_back(response.size());
+        response += reply;
+    }
+    for (size_t i = 0; i < offsets.size(); i++) {
+        size_t end = i + 1 < offsets.size() ? offsets[i + 1] : response.size();
+        replies.push_back(std::string_view(response).substr(offsets[i], end - offsets[i]));
+    }
+    return true;
+}
+
+std::string HyprlandIPC::send_request(const std::string& request) {
     std::string socket_path = get_socket_path(false); // Command socket
     if (socket_path.empty()) return "";
 
@@ -82,8 +128,7 @@ std::string HyprlandIPC::send_command(const std::string& cmd) {
     }
 
 
-    std::string full_cmd = "j/" + cmd;
-    if (write(cmd_fd, full_cmd.c_str(), full_cmd.length()) < 0) {
+    if (write(cmd_fd, request.c_str(), request.length()) < 0) {
         close(cmd_fd);
         return "";
     }
@@ -100,212 +145,778 @@ std::string HyprlandIPC::send_command(const std::string& cmd) {
     return response;
 }
 
-// Simple JSON scanner helpers
-std::string get_json_value(const std::string& json, const std::string& key) {
-    std::string search = "\"" + key + "\":";
-    size_t pos = json.find(search);
-    if (pos == std::string::npos) return "";
-    
-    pos += search.length();
-    
-    // Skip whitespace
-    while (pos < json.length() && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == '\r')) pos++;
-    
-    if (pos >= json.length()) return "";
+static bool is_ignored_class(std::string_view window_class) {
+    return window_class == "vidwall" ||
+           window_class == "dunst" ||
+           window_class == "mako" ||
+           window_class == "swaync" ||
+           window_class == "waybar" ||
+           window_class == "eww" ||
+           window_class == "quickshell" ||
+           window_class == "ags";
+}
+
+// Event payloads carry bare hex addresses, j/clients prefixes them with 0x
+static std::string_view normalize_address(std::string_view address) {
+    if (address.starts_with("0x")) address.remove_prefix(2);
+    return address;
+}
+
+void HyprlandIPC::add_window(std::string_view address, int workspace_id, std::string_view window_class) {
+    remove_window(address);
+
+    bool counted = !is_ignored_class(window_class);
+    windows.emplace(std::string(address), WindowInfo{workspace_id, counted, false, Rect{}, false, false});
+    if (counted) {
+        workspace_window_count[workspace_id]++;
+    }
+}
 
-    if (json[pos] == '"') {
+void HyprlandIPC::remove_window(std::string_view address) {
+    auto it = windows.find(address);
+    if (it == windows.end()) return;
 
-        // String value
-        size_t end = json.find('"', pos + 1);
-        if (end != std::string::npos) {
-            return json.substr(pos + 1, end - pos - 1);
+    if (it->second.counted) {
+        auto count = workspace_window_count.find(it->second.workspace_id);
+        if (count != workspace_window_count.end() && --count->second <= 0) {
+            workspace_window_count.erase(count);
         }
+    }
+    windows.erase(it);
+}
+
+void HyprlandIPC::move_window(std::string_view address, int workspace_id) {
+    auto it = windows.find(address);
+    if (it == windows.end()) return;
+
+    WindowInfo info = it->second;
+    if (info.workspace_id == workspace_id) return;
+
+    if (info.counted) {
+        auto count = workspace_window_count.find(info.workspace_id);
+        if (count != workspace_window_count.end() && --count->second <= 0) {
+            workspace_window_count.erase(count);
+        }
+        workspace_window_count[workspace_id]++;
+    }
+    it->second.workspace_id = workspace_id;
+}
+
+bool HyprlandIPC::lookup_workspace(std::string_view name, int& workspace_id) {
+    auto it = workspace_ids.find(name);
+    if (it == workspace_ids.end()) return false;
+    workspace_id = it->second;
+    return true;
+}
+
+void HyprlandIPC::set_workspace_name(std::string_view name, int workspace_id) {
+    auto it = workspace_ids.find(name);
+    if (it != workspace_ids.end()) {
+        it->second = workspace_id;
     } else {
+        workspace_ids.emplace(std::string(name), workspace_id);
+    }
+}
 
-        // Number or boolean
-        size_t end = pos;
-        while (end < json.length() && (isdigit(json[end]) || json[end] == '.' || json[end] == '-')) end++;
-        return json.substr(pos, end - pos);
+// True if anything coverage depends on changed
+bool HyprlandIPC::update_geometry(WindowInfo& window, const json_scan::ClientView& client) {
+    Rect geometry{client.x, client.y, client.width, client.height};
+    bool changed = window.has_geometry != client.has_geometry || window.fullscreen != client.fullscreen ||
+                   window.hidden != client.hidden || window.geometry.x != geometry.x ||
+                   window.geometry.y != geometry.y || window.geometry.width != geometry.width ||
+                   window.geometry.height != geometry.height;
+    window.has_geometry = client.has_geometry;
+    window.geometry = geometry;
+    window.fullscreen = client.fullscreen;
+    window.floating = client.floating;
+    window.hidden = client.hidden;
+    return changed;
+}
+
+// Opacity options are reported as {"option": ..., "float": 0.9, ...}
+static double option_float(std::string_view json, double fallback) {
+    std::string_view value;
+    double result = fallback;
+    if (json_scan::find_member(json, "float", value)) {
+        json_scan::parse_double(value, result);
     }
-    return "";
+    return result;
 }
 
-void HyprlandIPC::listen_events() {
-    char buffer[4096];
-    std::string pending_data;
-    
-    while (running) {
-        ssize_t n = read(socket_fd, buffer, sizeof(buffer) - 1);
-        if (n <= 0) {
-            if (running) {
-                std::cerr << "Lost connection to Hyprland IPC" << std::endl;
-                running = false;
-            }
-            break;
+bool HyprlandIPC::resync() {
+    // One round trip, so monitors, workspaces and clients are a consistent snapshot
+    std::string response;
+    std::vector<std::string_view> replies;
+    if (!send_batch({"monitors", "workspaces", "clients",
+                     "getoption decoration:active_opacity",
+                     "getoption decoration:inactive_opacity"}, response, replies)) {
+        std::cerr << "Failed to query Hyprland state" << std::endl;
+        return false;
+    }
+
+    std::string_view monitors_json = replies[0];
+    std::string_view workspaces_json = replies[1];
+    std::string_view clients_json = replies[2];
+
+    windows.clear();
+    workspace_window_count.clear();
+    workspace_ids.clear();
+    monitors.clear();
+    focused_monitor.clear();
+
+    bool ok = json_scan::for_each_monitor(monitors_json, [this](const json_scan::MonitorView& mon) {
+        // Window rects are in logical pixels, monitor modes are not
+        double scale = mon.scale > 0.0 ? mon.scale : 1.0;
+        int width = static_cast<int>(mon.width / scale + 0.5);
+        int height = static_cast<int>(mon.height / scale + 0.5);
+        if (mon.transform % 2 == 1) std::swap(width, height);
+
+        monitors.emplace(std::string(mon.name),
+                         MonitorInfo{mon.active_workspace_id, mon.special_workspace_id,
+                                     Rect{mon.x, mon.y, width, height}, mon.dpms_on});
+        if (mon.focused) {
+            focused_monitor = mon.name;
         }
-        
-        buffer[n] = '\0';
-        pending_data.append(buffer);
-        
-        bool needs_update = false;
-        size_t pos = 0;
-        while ((pos = pending_data.find('\n')) != std::string::npos) {
-            std::string line = pending_data.substr(0, pos);
-            pending_data.erase(0, pos + 1);
-            
-            
-            if (line.find("openwindow>>") == 0 ||
-                line.find("closewindow>>") == 0 ||
-                line.find("workspace>>") == 0 ||
-                line.find("movewindow>>") == 0 ||
-                line.find("movewindowv2>>") == 0 ||
-                line.find("focusedmon>>") == 0) {
-                
-                needs_update = true;
-            }
+    });
+
+    ok = ok && json_scan::for_each_workspace(workspaces_json, [this](const json_scan::WorkspaceView& ws) {
+        if (ws.has_id) {
+            set_workspace_name(ws.name, ws.workspace_id);
         }
-        
-        // Debounce: Only check once per read chunk if relevant events occurred
-        if (needs_update) {
-            // Small sleep to allow window state to settle
-            usleep(50000); 
-            
-            bool empty = is_workspace_empty();
-            if (on_focus_change) {
-                on_focus_change(!empty);
-            }
+    });
+
+    ok = ok && json_scan::for_each_client(clients_json, [this](const json_scan::ClientView& client) {
+        if (client.has_workspace) {
+            std::string_view address = normalize_address(client.address);
+            add_window(address, client.workspace_id, client.window_class);
+            update_geometry(windows.find(address)->second, client);
         }
+    });
+
+    if (!ok || monitors.empty()) {
+        std::cerr << "Failed to parse Hyprland state" << std::endl;
+        return false;
     }
+
+    // Opaque unless the compositor says otherwise
+    translucent = option_float(replies[3], 1.0) < 1.0 || option_float(replies[4], 1.0) < 1.0;
+
+    needs_resync = false;
+    geometry_dirty = false;
+    std::cout << "Window index synced: " << windows.size() << " windows, "
+              << workspace_ids.size() << " workspaces, " << monitors.size() << " monitors"
+              << (translucent ? ", translucent windows" : "") << std::endl;
+    return true;
 }
 
-bool HyprlandIPC::is_workspace_empty() {
-    //Get active workspace ID
-    std::string active_ws_json = send_command("activeworkspace");
-    if (active_ws_json.empty()) {
-        std::cerr << "Failed to get active workspace" << std::endl;
-        return true; 
+// Window rects are not part of the event stream. Re-read them with a single
+// clients query after events that move or resize windows; workspace
+// switches keep using the cached rects. changed, if given, tells whether
+// any rect differs from the cached one.
+bool HyprlandIPC::refresh_geometry(bool *changed) {
+    std::string clients_json = send_command("clients");
+
+    bool any_changed = false;
+    bool ok = json_scan::for_each_client(clients_json, [this, &any_changed](const json_scan::ClientView& client) {
+        auto it = windows.find(normalize_address(client.address));
+        if (it == windows.end()) {
+            needs_resync = true;   // missed an openwindow
+            return;
+        }
+        if (update_geometry(it->second, client)) any_changed = true;
+    });
+    if (changed) *changed = any_changed;
+
+    if (!ok) {
+        std::cerr << "Failed to query window geometry" << std::endl;
+        return false;
     }
-    
-    std::string ws_id_str = get_json_value(active_ws_json, "id");
-    if (ws_id_str.empty()) {
-        std::cerr << "Failed to parse active workspace ID" << std::endl;
+    geometry_dirty = false;
+    return true;
+}
+
+// Re-reads the DPMS state of every monitor. Returns true if it changed.
+bool HyprlandIPC::poll_power() {
+    std::string monitors_json = send_command("monitors");
+    bool changed = false;
+
+    bool ok = json_scan::for_each_monitor(monitors_json, [this, &changed](const json_scan::MonitorView& mon) {
+        auto it = monitors.find(mon.name);
+        if (it == monitors.end()) {
+            needs_resync = true;
+            changed = true;
+        } else if (it->second.powered != mon.dpms_on) {
+            it->second.powered = mon.dpms_on;
+            changed = true;
+            std::cout << "Monitor " << mon.name << " powered " << (mon.dpms_on ? "on" : "off") << std::endl;
+        }
+    });
+
+    return ok && changed;
+}
+
+void HyprlandIPC::set_active_workspace(std::string_view monitor, int workspace_id) {
+    auto it = monitors.find(monitor);
+    if (it == monitors.end()) {
+        needs_resync = true;
+        return;
+    }
+    it->second.active_workspace_id = workspace_id;
+}
+
+void HyprlandIPC::notify_prewarm(const std::string& monitor) {
+    if (!on_prewarm) return;
+
+    auto it = monitors.find(monitor);
+    if (it != monitors.end() && monitor_window_count(it->second) == 0) {
+        on_prewarm(monitor);
+    }
+}
+
+// Applies one event line to the window index.
+// Returns true if the event may change the pause decision.
+bool HyprlandIPC::apply_event(std::string_view line) {
+    size_t sep = line.find(">>");
+    if (sep == std::string_view::npos) return false;
+
+    HyprEvent event = classify_event(line.substr(0, sep));
+    std::string_view payload = line.substr(sep + 2);
+    int ws_id = 0;
+
+    switch (event) {
+    case HyprEvent::OpenWindow: {
+        // ADDRESS,WORKSPACENAME,CLASS,TITLE
+        EventFields f(payload, 4);
+        if (f.count < 3 || !lookup_workspace(f[1], ws_id)) {
+            needs_resync = true;
+        } else {
+            add_window(f[0], ws_id, f[2]);
+            geometry_dirty = true;
+        }
         return true;
     }
-    
-    int active_ws_id = std::atoi(ws_id_str.c_str());
-    
-    // Get all clients
-    std::string clients_json = send_command("clients");
-    if (clients_json.empty()) {
-        std::cerr << "Failed to get clients" << std::endl;
+
+    case HyprEvent::CloseWindow:
+        // ADDRESS
+        if (windows.find(payload) == windows.end()) {
+            needs_resync = true;
+        } else {
+            remove_window(payload);
+            geometry_dirty = true;   // tiled neighbours grow into the freed space
+        }
+        return true;
+
+    case HyprEvent::MoveWindowV2: {
+        // ADDRESS,WORKSPACEID,WORKSPACENAME
+        EventFields f(payload, 3);
+        if (f.count < 3 || windows.find(f[0]) == windows.end() ||
+            !json_scan::parse_int(f[1], ws_id)) {
+            needs_resync = true;
+        } else {
+            set_workspace_name(f[2], ws_id);
+            move_window(f[0], ws_id);
+            geometry_dirty = true;
+        }
         return true;
     }
-    
-    int window_count = 0;
-    
-    //Parsing
-    size_t pos = 0;
-    bool in_array = false;
-    
-    // Find start of array
-    pos = clients_json.find('[');
-    if (pos != std::string::npos) {
-        in_array = true;
-        pos++;
-    } else {
+
+    case HyprEvent::MoveWindow: {
+        // ADDRESS,WORKSPACENAME (pre-v2 compositors)
+        EventFields f(payload, 2);
+        if (f.count < 2 || windows.find(f[0]) == windows.end() || !lookup_workspace(f[1], ws_id)) {
+            needs_resync = true;
+        } else {
+            move_window(f[0], ws_id);
+            geometry_dirty = true;
+        }
         return true;
     }
-    
-    while (pos < clients_json.length()) {
-  
-        size_t start = clients_json.find('{', pos);
-        if (start == std::string::npos) break;
-        
-        // Find matching closing brace
-        int depth = 1;
-        size_t current = start + 1;
-        bool in_string = false;
-        
-        while (current < clients_json.length() && depth > 0) {
-            char c = clients_json[current];
-            if (c == '"' && (current == 0 || clients_json[current-1] != '\\')) {
-                in_string = !in_string;
-            } else if (!in_string) {
-                if (c == '{') depth++;
-                else if (c == '}') depth--;
+
+    case HyprEvent::WorkspaceV2: {
+        // WORKSPACEID,WORKSPACENAME
+        EventFields f(payload, 2);
+        // Switches the workspace of the focused monitor
+        if (f.count < 2 || !json_scan::parse_int(f[0], ws_id)) {
+            needs_resync = true;
+        } else {
+            set_workspace_name(f[1], ws_id);
+            set_active_workspace(focused_monitor, ws_id);
+            notify_prewarm(focused_monitor);
+        }
+        return true;
+    }
+
+    case HyprEvent::Workspace:
+        // WORKSPACENAME (pre-v2 compositors)
+        if (lookup_workspace(payload, ws_id)) {
+            set_active_workspace(focused_monitor, ws_id);
+            notify_prewarm(focused_monitor);
+        } else {
+            needs_resync = true;
+        }
+        return true;
+
+    case HyprEvent::FocusedMon: {
+        // MONNAME,WORKSPACENAME
+        EventFields f(payload, 2);
+        if (f.count < 2 || !lookup_workspace(f[1], ws_id)) {
+            needs_resync = true;
+        } else {
+            focused_monitor = f[0];
+            set_active_workspace(f[0], ws_id);
+        }
+        return true;
+    }
+
+    case HyprEvent::ActiveSpecial: {
+        // WORKSPACENAME,MONNAME (empty name when the special workspace closes)
+        EventFields f(payload, 2);
+        auto it = f.count == 2 ? monitors.find(f[1]) : monitors.end();
+        if (it == monitors.end()) {
+            needs_resync = true;
+        } else if (f[0].empty()) {
+            it->second.special_workspace_id = 0;
+        } else if (lookup_workspace(f[0], ws_id)) {
+            it->second.special_workspace_id = ws_id;
+        } else {
+            needs_resync = true;
+        }
+        return true;
+    }
+
+    case HyprEvent::ChangeFloatingMode:
+    case HyprEvent::Fullscreen:
+        // Window rects changed, the payload does not say how
+        geometry_dirty = true;
+        return true;
+
+    case HyprEvent::MoveWorkspace:
+    case HyprEvent::MoveWorkspaceV2:
+    case HyprEvent::MonitorAdded:
+    case HyprEvent::MonitorAddedV2:
+    case HyprEvent::MonitorRemoved:
+    case HyprEvent::ConfigReloaded:
+        // Workspace <-> monitor layout (or opacity) changed, cheaper to re-read than to patch
+        needs_resync = true;
+        return true;
+
+    case HyprEvent::CreateWorkspaceV2: {
+        // WORKSPACEID,WORKSPACENAME
+        EventFields f(payload, 2);
+        if (f.count == 2 && json_scan::parse_int(f[0], ws_id)) {
+            set_workspace_name(f[1], ws_id);
+        }
+        return false;
+    }
+
+    case HyprEvent::DestroyWorkspaceV2: {
+        // WORKSPACEID,WORKSPACENAME
+        EventFields f(payload, 2);
+        auto it = f.count == 2 ? workspace_ids.find(f[1]) : workspace_ids.end();
+        if (it != workspace_ids.end()) {
+            workspace_ids.erase(it);
+        }
+        return false;
+    }
+
+    case HyprEvent::RenameWorkspace: {
+        // WORKSPACEID,NEWNAME
+        EventFields f(payload, 2);
+        if (f.count < 2 || !json_scan::parse_int(f[0], ws_id)) return false;
+        std::erase_if(workspace_ids, [ws_id](const auto& entry) { return entry.second == ws_id; });
+        set_workspace_name(f[1], ws_id);
+        return false;
+    }
+
+    case HyprEvent::Unknown:
+        break;
+    }
+
+    return false;
+}
+
+// Reads whatever the event socket has buffered and applies complete lines.
+// Returns false once the connection is gone.
+bool HyprlandIPC::read_events() {
+    int flags = 0;
+
+    for (;;) {
+        size_t available = 0;
+        char *dest = event_ring.write_ptr(available);
+
+        ssize_t n = recv(socket_fd, dest, available, flags);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        event_ring.commit(n);
+
+        std::string_view line;
+        while (event_ring.next_line(line)) {
+            if (apply_event(line)) {
+                stat_events.fetch_add(1, std::memory_order_relaxed);
+                mark_pending();
             }
-            current++;
         }
-        
-        if (depth == 0) {
-
-            std::string client_obj = clients_json.substr(start, current - start);
-            
-            // Check workspace ID
-            size_t ws_pos = client_obj.find("\"workspace\":");
-            if (ws_pos != std::string::npos) {
-                std::string ws_part = client_obj.substr(ws_pos);
-                std::string id_val = get_json_value(ws_part, "id");
-                
-                if (!id_val.empty() && std::atoi(id_val.c_str()) == active_ws_id) {
-                  
-                    std::string class_val = get_json_value(client_obj, "class");
-                    
-                    // Filter ignored classes
-                    if (class_val != "vidwall" && 
-                        class_val != "dunst" && 
-                        class_val != "mako" && 
-                        class_val != "swaync" && 
-                        class_val != "waybar" && 
-                        class_val != "eww" &&
-                        class_val != "quickshell" && 
-                        class_val != "ags") {
-
-                        window_count++;
-
-                    }
+
+        // An event was lost, the index can no longer be trusted
+        if (event_ring.take_overflow()) {
+            std::cerr << "Oversized Hyprland event dropped, resyncing" << std::endl;
+            needs_resync = true;
+            mark_pending();
+        }
+
+        // Drain the rest of a burst without blocking so it is handled as one unit
+        flags = MSG_DONTWAIT;
+    }
+}
+
+// Coalescing latency is measured from the first change of a burst,
+// whatever it was
+void HyprlandIPC::mark_pending() {
+    if (!needs_update) {
+        first_pending_event = std::chrono::steady_clock::now();
+    }
+    needs_update = true;
+}
+
+void HyprlandIPC::arm_coalesce_timer() {
+    itimerspec spec{};
+    spec.it_value.tv_sec = coalesce_ms / 1000;
+    spec.it_value.tv_nsec = (coalesce_ms % 1000) * 1000000L;
+    timerfd_settime(timer_fd, 0, &spec, nullptr);
+    timer_armed = true;
+}
+
+void HyprlandIPC::evaluate() {
+    if (geometry_dirty && !needs_resync) {
+        refresh_geometry();   // on failure the previous rects are kept
+    }
+    if (needs_resync && !resync()) {
+        return;
+    }
+
+    auto latency = std::chrono::steady_clock::now() - first_pending_event;
+    uint64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    stat_evaluations.fetch_add(1, std::memory_order_relaxed);
+    stat_latency_total_us.fetch_add(latency_us, std::memory_order_relaxed);
+    if (latency_us > stat_latency_max_us.load(std::memory_order_relaxed)) {
+        stat_latency_max_us.store(latency_us, std::memory_order_relaxed);
+    }
+
+    if (!on_visibility_change) return;
+
+    for (const auto& [name, monitor] : monitors) {
+        double coverage = 0.0;
+        Visibility visibility = monitor_visibility(monitor, coverage);
+        std::cout << "Windows on " << name << " (workspace " << monitor.active_workspace_id
+                  << "): " << monitor_window_count(monitor) << ", "
+                  << static_cast<int>(coverage * 100.0 + 0.5) << "% covered, "
+                  << visibility_name(visibility) << std::endl;
+        on_visibility_change(name, visibility);
+    }
+}
+
+// Event coalescing (leading and trailing edge):
+// - the first event after a quiet period is evaluated as soon as the
+//   socket read that brought it is drained, and opens a coalescing window
+//   of coalesce_ms
+// - events arriving inside the window are only recorded, however many
+//   socket reads the burst spans
+// - the window's expiry evaluates them once and reopens it; a window that
+//   expires with nothing recorded closes, so the next event is immediate
+bool HyprlandIPC::dispatch_socket() {
+    if (!read_events()) {
+        if (running) {
+            std::cerr << "Lost connection to Hyprland IPC" << std::endl;
+            running = false;
+        }
+        return false;
+    }
+
+    flush_update();
+    return true;
+}
+
+// Evaluates pending changes now and opens a coalescing window behind them,
+// unless a window is open already
+void HyprlandIPC::flush_update() {
+    if (!needs_update || timer_armed) return;
+
+    needs_update = false;
+    evaluate();
+    if (coalesce_ms > 0 && timer_fd >= 0) {
+        arm_coalesce_timer();
+    }
+}
+
+void HyprlandIPC::dispatch_power_poll() {
+    uint64_t expirations;
+    if (read(poll_fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+
+    bool changed = poll_power();
+
+    // Dragging or resizing a floating window with the mouse sends no event,
+    // so shown floating windows are re-read on the same tick
+    bool moved = false;
+    if (floating_window_shown() && !needs_resync && refresh_geometry(&moved) && moved) {
+        changed = true;
+    }
+
+    if (changed) {
+        mark_pending();
+        flush_update();
+    }
+}
+
+bool HyprlandIPC::floating_window_shown() const {
+    for (const auto& [address, window] : windows) {
+        if (!window.floating || !window.counted || window.hidden) continue;
+        for (const auto& [name, monitor] : monitors) {
+            if (window.workspace_id == monitor.active_workspace_id ||
+                window.workspace_id == monitor.special_workspace_id) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void HyprlandIPC::dispatch_timer() {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+        return;   // Spurious wakeup, timer still pending
+    }
+    timer_armed = false;
+
+    // Only what arrived while the window was open
+    if (needs_update) {
+        needs_update = false;
+        evaluate();
+        arm_coalesce_timer();
+    }
+}
+
+void HyprlandIPC::listen_events() {
+    // Unused timers stay in the set with fd -1, which poll() ignores
+    pollfd fds[3] = {
+        {socket_fd, POLLIN, 0},
+        {timer_fd, POLLIN, 0},
+        {poll_fd, POLLIN, 0}
+    };
+
+    while (running) {
+        int ready = poll(fds, 3, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            dispatch_timer();
+        }
+
+        if (fds[2].revents & POLLIN) {
+            dispatch_power_poll();
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (!dispatch_socket()) break;
+        }
+    }
+}
+
+// O(1) lookup against the window index. The special workspace, when
+// shown, is drawn on top of the regular one and covers the wallpaper too.
+int HyprlandIPC::monitor_window_count(const MonitorInfo& monitor) const {
+    int count = 0;
+
+    auto it = workspace_window_count.find(monitor.active_workspace_id);
+    if (it != workspace_window_count.end()) count += it->second;
+
+    if (monitor.special_workspace_id != 0) {
+        it = workspace_window_count.find(monitor.special_workspace_id);
+        if (it != workspace_window_count.end()) count += it->second;
+    }
+    return count;
+}
+
+// Area covered by the union of the rects. Coordinate compression: the rect
+// edges split the plane into cells that are either fully covered or not.
+// Cubic in the number of windows on screen, which stays small.
+static long long union_area(const std::vector<HyprlandIPC::Rect>& rects) {
+    std::vector<int> xs, ys;
+    for (const auto& r : rects) {
+        xs.push_back(r.x);
+        xs.push_back(r.x + r.width);
+        ys.push_back(r.y);
+        ys.push_back(r.y + r.height);
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    long long area = 0;
+    for (size_t i = 0; i + 1 < xs.size(); i++) {
+        for (size_t j = 0; j + 1 < ys.size(); j++) {
+            for (const auto& r : rects) {
+                if (r.x <= xs[i] && xs[i + 1] <= r.x + r.width &&
+                    r.y <= ys[j] && ys[j + 1] <= r.y + r.height) {
+                    area += static_cast<long long>(xs[i + 1] - xs[i]) * (ys[j + 1] - ys[j]);
+                    break;
                 }
             }
-            
-            pos = current;
-        } else {
+        }
+    }
+    return area;
+}
+
+// Share of the monitor covered by windows of its shown workspaces.
+// Windows whose rect is still unknown count as covering everything, which
+// matches the old any-window-pauses behaviour until the rects arrive.
+Visibility HyprlandIPC::monitor_visibility(const MonitorInfo& monitor, double& coverage) const {
+    coverage = 0.0;
+    if (!monitor.powered) {
+        return Visibility::Off;
+    }
+    if (monitor_window_count(monitor) == 0) {
+        return Visibility::Visible;   // common case stays an O(1) lookup
+    }
+
+    const Rect& area = monitor.area;
+    std::vector<Rect> rects;
+    bool full = area.width <= 0 || area.height <= 0;
+
+    for (const auto& [address, window] : windows) {
+        if (full) break;
+        if (!window.counted || window.hidden) continue;
+        if (window.workspace_id != monitor.active_workspace_id &&
+            window.workspace_id != monitor.special_workspace_id) continue;
+
+        if (!window.has_geometry || window.fullscreen) {
+            full = true;
             break;
         }
+
+        // Clip to the monitor, floating windows may hang off its edge
+        const Rect& g = window.geometry;
+        int x0 = std::max(g.x, area.x);
+        int y0 = std::max(g.y, area.y);
+        int x1 = std::min(g.x + g.width, area.x + area.width);
+        int y1 = std::min(g.y + g.height, area.y + area.height);
+        if (x1 > x0 && y1 > y0) {
+            rects.push_back(Rect{x0, y0, x1 - x0, y1 - y0});
+        }
     }
-    
-    std::cout << "Windows on current workspace (" << active_ws_id << "): " << window_count << std::endl;
-    return window_count == 0;
+
+    coverage = full ? 1.0
+                    : static_cast<double>(union_area(rects)) /
+                      (static_cast<double>(area.width) * area.height);
+
+    if (coverage >= occlusion_threshold) {
+        return translucent ? Visibility::Partial : Visibility::Hidden;
+    }
+    return coverage > 0.0 ? Visibility::Partial : Visibility::Visible;
 }
 
-void HyprlandIPC::start_listening(FocusCallback callback) {
-    if (running) return;
-    
-    on_focus_change = callback;
+void HyprlandIPC::begin(VisibilityCallback callback) {
+    on_visibility_change = callback;
     running = true;
     
     // Initial check
-    bool empty = is_workspace_empty();
-    if (on_focus_change) {
-        on_focus_change(!empty);
-    }
+    first_pending_event = std::chrono::steady_clock::now();
+    evaluate();
     
+    if (coalesce_ms > 0) {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd < 0) {
+            std::cerr << "Failed to create coalescing timer, evaluating every event" << std::endl;
+        }
+    }
+
+    if (power_poll_s > 0) {
+        poll_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (poll_fd >= 0) {
+            itimerspec spec{};
+            spec.it_value.tv_sec = power_poll_s;
+            spec.it_interval.tv_sec = power_poll_s;
+            timerfd_settime(poll_fd, 0, &spec, nullptr);
+        } else {
+            std::cerr << "Failed to create DPMS poll timer, output power state not tracked" << std::endl;
+        }
+    }
+}
+
+void HyprlandIPC::start_listening(VisibilityCallback callback) {
+    if (running) return;
+
+    begin(callback);
     listener_thread = std::thread(&HyprlandIPC::listen_events, this);
 }
 
+void HyprlandIPC::start_attached(VisibilityCallback callback) {
+    if (running) return;
+
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
+
+    begin(callback);
+}
+
 void HyprlandIPC::stop_listening() {
     if (!running) return;
     
     running = false;
     
-    // Close socket to wake up thread
+    // Shut the socket down to wake up the thread, close it once the thread is gone
     if (socket_fd >= 0) {
         shutdown(socket_fd, SHUT_RDWR);
-        close(socket_fd);
-        socket_fd = -1;
     }
     
     if (listener_thread.joinable()) {
         listener_thread.join();
     }
+
+    if (socket_fd >= 0) {
+        close(socket_fd);
+        socket_fd = -1;
+    }
+    if (timer_fd >= 0) {
+        close(timer_fd);
+        timer_fd = -1;
+    }
+    if (poll_fd >= 0) {
+        close(poll_fd);
+        poll_fd = -1;
+    }
+}
+
+void HyprlandIPC::set_coalesce_window(int ms) {
+    coalesce_ms = ms < 0 ? 0 : ms;
+}
+
+void HyprlandIPC::set_power_poll_interval(int seconds) {
+    power_poll_s = seconds < 0 ? 0 : seconds;
+}
+
+void HyprlandIPC::set_occlusion_threshold(int percent) {
+    occlusion_threshold = std::clamp(percent, 0, 100) / 100.0;
+}
+
+void HyprlandIPC::set_prewarm_callback(PrewarmCallback callback) {
+    on_prewarm = callback;
+}
+
+HyprlandIPC::Stats HyprlandIPC::take_stats() {
+    Stats stats;
+    stats.events = stat_events.exchange(0, std::memory_order_relaxed);
+    stats.evaluations = stat_evaluations.exchange(0, std::memory_order_relaxed);
+    uint64_t total_us = stat_latency_total_us.exchange(0, std::memory_order_relaxed);
+    stats.avg_latency_ms = stats.evaluations > 0 ? total_us / 1000.0 / stats.evaluations : 0.0;
+    stats.max_latency_ms = stat_latency_max_us.exchange(0, std::memory_order_relaxed) / 1000.0;
+    return stats;
 }
 
@@ -0,0 +1,177 @@
+#include "../include/json_scan.h"
+#include <charconv>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Returns the offset of the next '"' or '\\' in [p, p + n), or n.
+// String bodies (window titles in particular) make up most of a clients
+// reply, so this is the only loop worth vectorizing.
+static size_t find_string_special(const char *p, size_t n) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                  _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (p[i] == '"' || p[i] == '\\') return i;
+    }
+    return n;
+}
+
+JsonScanner::JsonScanner(std::string_view json) : json(json) {}
+
+JsonScanner::Token JsonScanner::push(bool object) {
+    if (stack_size >= MAX_DEPTH) return Token::Error;
+    is_object[stack_size++] = object;
+    expect_key = object;
+    return object ? Token::ObjectStart : Token::ArrayStart;
+}
+
+JsonScanner::Token JsonScanner::pop(bool object) {
+    if (stack_size == 0 || is_object[stack_size - 1] != object) return Token::Error;
+    stack_size--;
+    expect_key = false;
+    return object ? Token::ObjectEnd : Token::ArrayEnd;
+}
+
+JsonScanner::Token JsonScanner::next() {
+    const size_t len = json.size();
+
+    // Skip whitespace and separators
+    while (pos < len) {
+        char c = json[pos];
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ':') {
+            pos++;
+        } else if (c == ',') {
+            pos++;
+            expect_key = stack_size > 0 && is_object[stack_size - 1];
+        } else {
+            break;
+        }
+    }
+
+    if (pos >= len) return Token::End;
+
+    char c = json[pos++];
+    switch (c) {
+    case '{': return push(true);
+    case '[': return push(false);
+    case '}': return pop(true);
+    case ']': return pop(false);
+    case '"': {
+        size_t start = pos;
+        while (pos < len) {
+            pos += find_string_special(json.data() + pos, len - pos);
+            if (pos < len && json[pos] == '\\') {
+                pos += 2;   // escaped character
+                continue;
+            }
+            break;
+        }
+        if (pos >= len) return Token::Error;
+
+        token_text = json.substr(start, pos - start);
+        pos++;   // closing quote
+
+        if (expect_key) {
+            expect_key = false;
+            return Token::Key;
+        }
+        return Token::String;
+    }
+    default: {
+        size_t start = pos - 1;
+        while (pos < len) {
+            char d = json[pos];
+            if (d == ',' || d == '}' || d == ']' || d == ' ' || d == '\n' || d == '\r' || d == '\t') break;
+            pos++;
+        }
+        token_text = json.substr(start, pos - start);
+        return Token::Scalar;
+    }
+    }
+}
+
+JsonScanner::Token JsonScanner::skip_container() {
+    int target = stack_size - 1;
+    for (;;) {
+        Token tok = next();
+        if (tok == Token::End || tok == Token::Error) return tok;
+        if ((tok == Token::ObjectEnd || tok == Token::ArrayEnd) && stack_size == target) return tok;
+    }
+}
+
+namespace json_scan {
+
+bool parse_int(std::string_view text, int& out) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc();
+}
+
+bool parse_double(std::string_view text, double& out) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc();
+}
+
+bool find_member(std::string_view json, std::string_view key, std::string_view& out) {
+    JsonScanner scanner(json);
+    if (scanner.next() != JsonScanner::Token::ObjectStart) return false;
+
+    for (;;) {
+        JsonScanner::Token tok = scanner.next();
+        if (tok == JsonScanner::Token::End || tok == JsonScanner::Token::Error ||
+            tok == JsonScanner::Token::ObjectEnd) {
+            return false;
+        }
+        if (tok != JsonScanner::Token::Key) continue;
+
+        bool match = scanner.text() == key;
+        tok = scanner.next();
+        if (tok == JsonScanner::Token::ObjectStart || tok == JsonScanner::Token::ArrayStart) {
+            scanner.skip_container();
+        } else if (match) {
+            out = scanner.text();
+            return true;
+        }
+    }
+}
+
+bool split_values(std::string_view json, std::vector<std::string_view>& out) {
+    size_t pos = 0;
+    for (;;) {
+        while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\n' ||
+                                     json[pos] == '\r' || json[pos] == '\t')) {
+            pos++;
+        }
+        if (pos >= json.size()) return !out.empty();
+
+        JsonScanner scanner(json.substr(pos));
+        // Hyprland replies are objects or arrays; anything else is an error message
+        JsonScanner::Token tok = scanner.next();
+        if (tok != JsonScanner::Token::ObjectStart && tok != JsonScanner::Token::ArrayStart) {
+            return false;
+        }
+        tok = scanner.skip_container();
+        if (tok == JsonScanner::Token::End || tok == JsonScanner::Token::Error) {
+            return false;
+        }
+
+        out.push_back(json.substr(pos, scanner.offset()));
+        pos += scanner.offset();
+    }
+}
+
+} // namespace json_scan
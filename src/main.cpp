@@ -1,501 +1,570 @@
 #include <gtk/gtk.h>
-#include <gtk4-layer-shell.h>
-#include <mpv/client.h>
-#include <mpv/render_gl.h>
+#include <glib-unix.h>
 #include <iostream>
 #include <locale.h>
-#include <epoxy/gl.h>
-#include <epoxy/egl.h>
 #include "hyprland_ipc.h"
 #include "cli_args.h"
+#include "wallpaper_output.h"
+#include "session_lock.h"
+#include "offscreen_decoder.h"
+#include "wayland_backend.h"
+#include "resource_usage.h"
+#include "memory_source.h"
+#include "transcode_cache.h"
+#include <algorithm>
+#include <memory>
 #include <mutex>
-#include <atomic>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 static CliArgs g_args;
 
 class HyprVidWall;
-static void on_focus_changed(bool has_focus, HyprVidWall *self);
+static void on_visibility_changed(const std::string& monitor, Visibility visibility, HyprVidWall *self);
+static void on_prewarm_requested(const std::string& monitor, HyprVidWall *self);
 
-struct FocusChangeData {
+struct VisibilityChangeData {
     class HyprVidWall *self;
-    bool has_focus;
-    guint *pending_id;
-    std::mutex *mutex;
+    std::string monitor;
+    Visibility visibility;
+};
+
+struct PrewarmData {
+    class HyprVidWall *self;
+    std::string monitor;
 };
 
 class HyprVidWall {
 private:
     GtkApplication *app;
-    GtkWindow *window;
-    GtkWidget *gl_area;
-    mpv_handle *mpv;
-    mpv_render_context *mpv_gl;
-    guint render_timer_id;
-    guint event_timer_id;
     guint stats_timer_id;
     HyprlandIPC hypr_ipc;
-    std::atomic<bool> is_paused;
+    SessionLock session_lock;
     CliArgs args;
-    guint pending_resize_id;
-    int64_t last_video_width = 0;
-    int64_t last_video_height = 0;
-    std::atomic<uint64_t> render_count{0};
-    std::atomic<uint64_t> render_count_snapshot{0};
-
-    static void *get_proc_address(void *ctx, const char *name) {
-        (void)ctx;
-        return (void *)eglGetProcAddress(name);
+    std::unique_ptr<WaylandConnection> wayland;         // --backend wayland, outlives the outputs
+    std::unique_ptr<OffscreenDecoder> shared_decoder;   // --shared-decoder, outlives the outputs
+    std::vector<std::unique_ptr<WallpaperOutput>> outputs;
+    std::unordered_map<std::string, Visibility> monitor_visibility;   // last decision per monitor name
+    GListModel *monitor_list = nullptr;
+    gulong monitors_changed_id = 0;
+    bool ipc_active = false;
+    guint ipc_socket_watch_id = 0;
+    guint ipc_timer_watch_id = 0;
+    guint ipc_poll_watch_id = 0;
+    int64_t stats_cpu_us = -1;   // process CPU time at the previous stats line
+    int64_t stats_read_syscalls = -1;
+    transcode_cache::Entry optimized;   // --optimize copy found or made for this video
+    bool playing_optimized = false;
+
+    // Where offscreen frames are rendered and how long the main loop takes
+    // to pick them up; with a render thread, main loop stalls show up in
+    // handoff and superseded, not in mpv's late drops
+    static void print_decoder_stats(const std::string& label, OffscreenDecoder& decoder) {
+        OffscreenDecoder::Stats stats = decoder.take_stats();
+        std::cout << "[stats] " << label
+                  << (decoder.threaded() ? " render_thread" : " render_main")
+                  << " downscale=" << downscale_path_name(decoder.downscale_path())
+                  << " frames/sec=" << stats.frames / 5.0
+                  << " render_ms(avg/max)=" << stats.avg_render_ms << "/" << stats.max_render_ms
+                  << " handoff_ms(avg/max)=" << stats.avg_handoff_ms << "/" << stats.max_handoff_ms
+                  << " superseded=" << stats.superseded
+                  << " late_drops=" << stats.late_drops
+                  << std::endl;
     }
 
-    // Called from mpv's render thread when a new frame is ready
-    static void on_mpv_render_update(void *ctx) {
-        auto *self = static_cast<HyprVidWall*>(ctx);
-        if (self->is_paused.load(std::memory_order_relaxed)) return;
-        g_idle_add([](gpointer user_data) -> gboolean {
-            auto *self = static_cast<HyprVidWall*>(user_data);
-            if (!self->is_paused.load(std::memory_order_relaxed)) {
-                gtk_gl_area_queue_render(GTK_GL_AREA(self->gl_area));
+    // Diagnostics (--stats): logs render rate every 5 seconds
+    static gboolean on_stats_timer(gpointer user_data) {
+        auto *self = static_cast<HyprVidWall*>(user_data);
+
+        uint64_t presents = 0;
+        uint64_t loops = 0;
+        for (auto& output : self->outputs) {
+            uint64_t output_presents = output->take_present_count();
+            presents += output_presents;
+            double source_fps = 0.0, filtered_fps = 0.0;
+            output->get_decode_rates(source_fps, filtered_fps);
+            WallpaperOutput::TransitionStats transitions = output->take_transition_stats();
+            WallpaperOutput::LoopStats loop_stats = output->take_loop_stats();
+            loops += loop_stats.loops;
+            std::string static_skip;
+            if (output->skipped_fraction() >= 0.0) {
+                int percent = static_cast<int>(output->skipped_fraction() * 100.0 + 0.5);
+                static_skip = " static_skipped=" + std::to_string(percent) + "%";
             }
-            return G_SOURCE_REMOVE;
-        }, self);
+            double render_ms = 0.0, render_max_ms = 0.0;
+            output->take_render_time(render_ms, render_max_ms);
+            std::ostringstream gpu_time;
+            double gpu_ms = 0.0, gpu_max_ms = 0.0;
+            if (output->take_gpu_time(gpu_ms, gpu_max_ms)) {
+                gpu_time << " gpu_ms(avg/max)=" << gpu_ms << "/" << gpu_max_ms;
+            }
+            // decode -> render -> present, each stage should be at or below the previous
+            std::cout << "[stats] " << output->get_name()
+                      << " decode_fps(source/filtered)=" << source_fps << "/" << filtered_fps
+                      << (output->decoder_skipping() ? " decoder_skip=nonref" : "")
+                      << static_skip
+                      << " renders/sec=" << output->take_render_count() / 5.0
+                      << " render_ms(avg/max)=" << render_ms << "/" << render_max_ms
+                      << gpu_time.str()
+                      << " downscale=" << downscale_path_name(output->downscale_path())
+                      << " presents/sec=" << output_presents / 5.0
+                      << " paused=" << (output->paused() ? "yes" : "no")
+                      << " reduced=" << (output->reduced_rate() ? "yes" : "no")
+                      << " avoided_transitions=" << transitions.avoided
+                      << " prewarms=" << transitions.prewarms
+                      << " wasted_prewarms=" << transitions.wasted_prewarms
+                      << " reveal_to_frame_ms(avg/max)=" << transitions.avg_reveal_ms
+                      << "/" << transitions.max_reveal_ms
+                      << " loops=" << loop_stats.loops
+                      << " loop_seam_ms(avg/max)=" << loop_stats.avg_seam_ms << "/" << loop_stats.max_seam_ms
+                      << " frame_cache=" << output->frame_cache_state()
+                      << "(" << output->frame_cache_frames() << " frames, "
+                      << output->frame_cache_bytes() / (1024.0 * 1024.0) << " MB)"
+                      << std::endl;
+            if (output->own_decoder()) {
+                print_decoder_stats(output->get_name(), *output->own_decoder());
+            }
+        }
+
+        if (self->shared_decoder) {
+            print_decoder_stats("shared", *self->shared_decoder);
+        }
+
+        // Whole-process cost of a frame on screen, decode included; compares
+        // backends (e.g. software against GL on llvmpipe) on one machine
+        int64_t cpu_us = resource_usage::cpu_time_us();
+        if (self->stats_cpu_us >= 0 && cpu_us >= 0) {
+            double cpu_ms = (cpu_us - self->stats_cpu_us) / 1000.0;
+            std::cout << "[stats] backend=" << (self->wayland ? self->args.backend : "gtk")
+                      << " cpu_ms/sec=" << cpu_ms / 5.0
+                      << " cpu_ms/frame=" << (presents > 0 ? cpu_ms / presents : 0.0)
+                      << std::endl;
+        }
+        self->stats_cpu_us = cpu_us;
+
+        // Measured flat out when the copy was made, next to the live cpu_ms/frame
+        if (!self->optimized.file.empty()) {
+            std::cout << "[stats] playing=" << (self->playing_optimized ? "optimized" : "source")
+                      << " decode_cpu_ms/frame(source/optimized)=" << self->optimized.source.cpu_ms_per_frame
+                      << "/" << self->optimized.optimized.cpu_ms_per_frame
+                      << " decode_fps(source/optimized)=" << self->optimized.source.fps
+                      << "/" << self->optimized.optimized.fps
+                      << std::endl;
+        }
+
+        // Loop I/O: process-wide read syscalls (the IPC socket included)
+        // against reads served from memory with --preload
+        int64_t read_syscalls = resource_usage::read_syscalls();
+        if (self->stats_read_syscalls >= 0 && read_syscalls >= 0) {
+            int64_t syscalls = read_syscalls - self->stats_read_syscalls;
+            memory_source::Stats preload = memory_source::take_stats();
+            std::cout << "[stats] read_syscalls/sec=" << syscalls / 5.0
+                      << " read_syscalls/loop=" << (loops > 0 ? static_cast<double>(syscalls) / loops : 0.0)
+                      << " preload_opens=" << preload.opens
+                      << " preload_reads=" << preload.reads
+                      << " preload_mb=" << preload.bytes / (1024.0 * 1024.0)
+                      << std::endl;
+        }
+        self->stats_read_syscalls = read_syscalls;
+
+        if (self->ipc_active) {
+            HyprlandIPC::Stats ipc = self->hypr_ipc.take_stats();
+            std::cout << "[stats] ipc_events=" << ipc.events
+                      << " ipc_decisions=" << ipc.evaluations
+                      << " decision_latency_ms(avg/max)=" << ipc.avg_latency_ms
+                      << "/" << ipc.max_latency_ms
+                      << std::endl;
+        }
+        return G_SOURCE_CONTINUE;
     }
 
-    // ~60 FPS render timer, self-removes when paused
-    static gboolean on_render_timer(gpointer user_data) {
+    // Main-loop IPC mode: Hyprland event socket became readable
+    static gboolean on_ipc_socket_ready(gint fd, GIOCondition condition, gpointer user_data) {
+        (void)fd; (void)condition;
         auto *self = static_cast<HyprVidWall*>(user_data);
-        if (self->is_paused.load(std::memory_order_relaxed)) {
-            self->render_timer_id = 0;
+
+        if (!self->hypr_ipc.dispatch_socket()) {
+            self->ipc_socket_watch_id = 0;
+            if (self->ipc_timer_watch_id > 0) {
+                g_source_remove(self->ipc_timer_watch_id);
+                self->ipc_timer_watch_id = 0;
+            }
+            if (self->ipc_poll_watch_id > 0) {
+                g_source_remove(self->ipc_poll_watch_id);
+                self->ipc_poll_watch_id = 0;
+            }
             return G_SOURCE_REMOVE;
         }
-        self->render_count.fetch_add(1, std::memory_order_relaxed);
-        gtk_gl_area_queue_render(GTK_GL_AREA(self->gl_area));
         return G_SOURCE_CONTINUE;
     }
 
-    // Drains mpv event queue (250ms interval)
-    static gboolean on_event_timer(gpointer user_data) {
+    // Main-loop IPC mode: coalescing window expired
+    static gboolean on_ipc_timer_ready(gint fd, GIOCondition condition, gpointer user_data) {
+        (void)fd; (void)condition;
         auto *self = static_cast<HyprVidWall*>(user_data);
-        self->handle_mpv_events();
+        self->hypr_ipc.dispatch_timer();
         return G_SOURCE_CONTINUE;
     }
 
-    // Diagnostics: logs render rate every 5 seconds
-    static gboolean on_stats_timer(gpointer user_data) {
+    // Main-loop IPC mode: time to re-read DPMS state
+    static gboolean on_ipc_poll_ready(gint fd, GIOCondition condition, gpointer user_data) {
+        (void)fd; (void)condition;
         auto *self = static_cast<HyprVidWall*>(user_data);
-        uint64_t current = self->render_count.load(std::memory_order_relaxed);
-        uint64_t prev = self->render_count_snapshot.load(std::memory_order_relaxed);
-        uint64_t delta = current - prev;
-        self->render_count_snapshot.store(current, std::memory_order_relaxed);
-        double fps = delta / 5.0;
-        std::cout << "[stats] renders/sec=" << fps
-                  << " paused=" << (self->is_paused.load(std::memory_order_relaxed) ? "yes" : "no")
-                  << " timer_active=" << (self->render_timer_id > 0 ? "yes" : "no")
-                  << std::endl;
+        self->hypr_ipc.dispatch_power_poll();
         return G_SOURCE_CONTINUE;
     }
 
-    void handle_mpv_events() {
-        while (mpv) {
-            mpv_event *event = mpv_wait_event(mpv, 0);
-            if (event->event_id == MPV_EVENT_NONE) break;
-
-            if (event->event_id == MPV_EVENT_END_FILE) {
-                if (is_paused.load(std::memory_order_relaxed)) return;
+    // Monitor hotplug: GDK's monitor list changed
+    static void on_monitors_changed(GListModel *list, guint position, guint removed, guint added,
+                                    gpointer user_data) {
+        (void)list; (void)position; (void)removed; (void)added;
+        auto *self = static_cast<HyprVidWall*>(user_data);
+        self->sync_outputs();
+    }
 
-                mpv_event_end_file *ef = (mpv_event_end_file *)event->data;
-                if (ef->reason == MPV_END_FILE_REASON_ERROR) {
-                    std::cerr << "Error, reloading..." << std::endl;
-                    load_video();
-                }
-            } else if (event->event_id == MPV_EVENT_FILE_LOADED) {
-                std::cout << "Video loaded" << std::endl;
-
-                int64_t width = 0, height = 0;
-                mpv_get_property(mpv, "width", MPV_FORMAT_INT64, &width);
-                mpv_get_property(mpv, "height", MPV_FORMAT_INT64, &height);
-
-                if (width > 0 && height > 0 &&
-                    (width != last_video_width || height != last_video_height)) {
-                    last_video_width = width;
-                    last_video_height = height;
-                    adjust_window_for_aspect_ratio(width, height);
-                }
-            }
+    void start_ipc_main_loop() {
+        // Decisions arrive on the main thread, no marshalling needed
+        hypr_ipc.set_prewarm_callback([this](const std::string& monitor) {
+            apply_prewarm(monitor);
+        });
+        hypr_ipc.start_attached([this](const std::string& monitor, Visibility visibility) {
+            apply_visibility(monitor, visibility);
+        });
+
+        ipc_socket_watch_id = g_unix_fd_add(hypr_ipc.event_fd(),
+                                            (GIOCondition)(G_IO_IN | G_IO_HUP | G_IO_ERR),
+                                            on_ipc_socket_ready, this);
+        if (hypr_ipc.coalesce_timer_fd() >= 0) {
+            ipc_timer_watch_id = g_unix_fd_add(hypr_ipc.coalesce_timer_fd(), G_IO_IN,
+                                               on_ipc_timer_ready, this);
+        }
+        if (hypr_ipc.power_poll_fd() >= 0) {
+            ipc_poll_watch_id = g_unix_fd_add(hypr_ipc.power_poll_fd(), G_IO_IN,
+                                              on_ipc_poll_ready, this);
         }
     }
 
-    void adjust_window_for_aspect_ratio(int64_t video_width, int64_t video_height) {
-        double aspect_ratio = (double)video_width / (double)video_height;
-
-        std::cout << "Video: " << video_width << "x" << video_height
-                  << " (aspect: " << aspect_ratio << ")" << std::endl;
+    // A locked session shows only the lock screen
+    Visibility effective_visibility(Visibility visibility) const {
+        return session_lock.locked() ? Visibility::Off : visibility;
+    }
 
-        GdkDisplay *display = gdk_display_get_default();
-        GdkSurface *surface = gtk_native_get_surface(GTK_NATIVE(window));
-        GdkMonitor *monitor = gdk_display_get_monitor_at_surface(display, surface);
-        GdkRectangle geom;
-        gdk_monitor_get_geometry(monitor, &geom);
+    Visibility last_visibility(const std::string& monitor) const {
+        auto it = monitor_visibility.find(monitor);
+        return it != monitor_visibility.end() ? it->second : Visibility::Visible;
+    }
 
-        if (pending_resize_id > 0) {
-            g_source_remove(pending_resize_id);
-            pending_resize_id = 0;
+    void apply_lock_state() {
+        for (auto& output : outputs) {
+            output->set_visibility(effective_visibility(last_visibility(output->get_name())));
         }
+    }
 
-        // Vertical video (9:16 or similar) - resize to maintain aspect ratio
-        if (aspect_ratio < 1.0) {
-            int window_width = (int)(geom.height * aspect_ratio);
-
-            struct ResizeData {
-                HyprVidWall *self;
-                int width;
-                int height;
-            };
-
-            auto *data = new ResizeData{this, window_width, geom.height};
-
-            pending_resize_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, [](gpointer user_data) -> gboolean {
-                auto *resize_data = static_cast<ResizeData*>(user_data);
-                resize_data->self->pending_resize_id = 0;
+    // Creates a wallpaper surface for every new monitor and drops the ones
+    // whose monitor went away
+    void sync_outputs() {
+        std::vector<GdkMonitor*> current;
+        guint n = g_list_model_get_n_items(monitor_list);
+        for (guint i = 0; i < n; i++) {
+            auto *monitor = GDK_MONITOR(g_list_model_get_item(monitor_list, i));
+            current.push_back(monitor);
+            g_object_unref(monitor);   // the list keeps its own reference
+        }
 
-                gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_LEFT, FALSE);
-                gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_RIGHT, FALSE);
-                gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_TOP, TRUE);
-                gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_BOTTOM, TRUE);
+        std::erase_if(outputs, [&current](const std::unique_ptr<WallpaperOutput>& output) {
+            bool gone = std::find(current.begin(), current.end(), output->get_monitor()) == current.end();
+            if (gone) {
+                std::cout << "Monitor removed: " << output->get_name() << std::endl;
+            }
+            return gone;
+        });
 
-                gtk_widget_set_size_request(GTK_WIDGET(resize_data->self->window),
-                                           resize_data->width,
-                                           resize_data->height);
+        for (GdkMonitor *monitor : current) {
+            bool known = std::any_of(outputs.begin(), outputs.end(),
+                [monitor](const std::unique_ptr<WallpaperOutput>& output) {
+                    return output->get_monitor() == monitor;
+                });
+            if (known) continue;
 
-                return G_SOURCE_REMOVE;
-            }, data, [](gpointer user_data) {
-                delete static_cast<ResizeData*>(user_data);
-            });
+            const char *connector = gdk_monitor_get_connector(monitor);
+            Visibility initial = effective_visibility(last_visibility(connector ? connector : ""));
 
-            std::cout << "Vertical video: will resize to " << window_width << "x" << geom.height << "px" << std::endl;
-        } else {
-            std::cout << "Horizontal video: keeping fullscreen" << std::endl;
+            auto output = std::make_unique<WallpaperOutput>(app, monitor, args, initial,
+                                                            shared_decoder.get(), wayland.get());
+            if (!output->start()) {
+                std::cerr << "Skipping monitor " << output->get_name() << std::endl;
+                continue;
+            }
+            std::cout << "Monitor added: " << output->get_name() << std::endl;
+            outputs.push_back(std::move(output));
         }
     }
 
-    static void on_activate(GtkApplication *app, gpointer user_data) {
-        auto *self = static_cast<HyprVidWall*>(user_data);
-        (void)app;
-        self->setup_window();
-        self->setup_mpv();
-
-        if (!self->mpv) {
-            std::cerr << "Fatal: mpv setup failed, cannot continue" << std::endl;
-            g_application_quit(G_APPLICATION(self->app));
-            return;
+    // Plays the --optimize copy for the current monitors if there is one,
+    // transcoding first with --optimize. The copy is made for the largest
+    // monitor, later hotplugs do not change it.
+    void select_optimized_copy() {
+        transcode_cache::Target target;
+        GListModel *monitors = gdk_display_get_monitors(gdk_display_get_default());
+        guint n = g_list_model_get_n_items(monitors);
+        for (guint i = 0; i < n; i++) {
+            auto *monitor = GDK_MONITOR(g_list_model_get_item(monitors, i));
+            GdkRectangle geom;
+            gdk_monitor_get_geometry(monitor, &geom);
+#if GTK_CHECK_VERSION(4, 14, 0)
+            double scale = gdk_monitor_get_scale(monitor);
+#else
+            double scale = gdk_monitor_get_scale_factor(monitor);
+#endif
+            target.width = std::max(target.width, static_cast<int>(geom.width * scale + 0.5));
+            target.height = std::max(target.height, static_cast<int>(geom.height * scale + 0.5));
+            g_object_unref(monitor);
         }
+        if (target.width <= 0 || target.height <= 0) return;
+        target.fps = args.fps;
+        target.audio = !args.mute;
 
-        self->setup_gl_rendering();
+        optimized = transcode_cache::lookup(args.video_path, target);
+        if (optimized.file.empty() && args.optimize) {
+            optimized = transcode_cache::create(args.video_path, target, args);
+        }
+        if (optimized.file.empty()) return;
 
-        if (!self->mpv_gl) {
-            std::cerr << "Fatal: GL rendering setup failed, cannot continue" << std::endl;
-            g_application_quit(G_APPLICATION(self->app));
+        if (!transcode_cache::worthwhile(optimized)) {
+            std::cout << "Optimized copy decodes no cheaper, playing the original" << std::endl;
             return;
         }
+        std::cout << "Playing optimized copy: " << optimized.file << std::endl;
+        args.video_path = optimized.file;
+        playing_optimized = true;
+    }
+
+    static void on_activate(GtkApplication *app, gpointer user_data) {
+        auto *self = static_cast<HyprVidWall*>(user_data);
 
-        self->render_timer_id = g_timeout_add(16, on_render_timer, self);
-        self->event_timer_id = g_timeout_add(250, on_event_timer, self);
-        self->stats_timer_id = g_timeout_add(5000, on_stats_timer, self);
+        // Outputs come and go with hotplug; stay alive with zero windows
+        g_application_hold(G_APPLICATION(app));
 
         if (self->args.auto_pause) {
             if (self->hypr_ipc.connect()) {
-                self->hypr_ipc.start_listening([self](bool has_focus) {
-                    on_focus_changed(has_focus, self);
-                });
-                std::cout << "Auto-pause enabled" << std::endl;
+                self->ipc_active = true;
+                self->hypr_ipc.set_coalesce_window(self->args.coalesce_ms);
+                self->hypr_ipc.set_occlusion_threshold(self->args.occlusion_pct);
+                self->hypr_ipc.set_power_poll_interval(self->args.dpms_poll_s);
+                if (self->args.ipc_main_loop) {
+                    self->start_ipc_main_loop();
+                } else {
+                    self->hypr_ipc.set_prewarm_callback([self](const std::string& monitor) {
+                        on_prewarm_requested(monitor, self);
+                    });
+                    self->hypr_ipc.start_listening([self](const std::string& monitor, Visibility visibility) {
+                        on_visibility_changed(monitor, visibility, self);
+                    });
+                }
+                std::cout << "Auto-pause enabled"
+                          << (self->args.ipc_main_loop ? " (main loop IPC)" : "") << std::endl;
             } else {
                 std::cout << "Hyprland IPC not available - auto-pause disabled" << std::endl;
             }
+
+            // Signals are delivered on the main loop
+            if (self->session_lock.start([self](bool) { self->apply_lock_state(); })) {
+                std::cout << "Pausing while the session is locked" << std::endl;
+            }
         } else {
             std::cout << "Auto-pause disabled" << std::endl;
         }
 
-        self->load_video();
-    }
-
-public:
-    guint pending_focus_change_id;
-    std::mutex focus_mutex;
-
-    void pause_video() {
-        if (!mpv || is_paused) return;
-
-        is_paused = true;
-
-        // Freeze mpv pipeline in-place (decoder/render threads go idle immediately)
-        mpv_set_property_string(mpv, "pause", "yes");
-
-        if (render_timer_id > 0) {
-            g_source_remove(render_timer_id);
-            render_timer_id = 0;
-        }
-
-        if (mpv_gl) {
-            mpv_render_context_set_update_callback(mpv_gl, nullptr, nullptr);
+        if (self->args.fps > 0) {
+            std::cout << "Frame cap: " << self->args.fps << " fps" << std::endl;
         }
 
-        std::cout << "Video paused" << std::endl;
-    }
-
-    void resume_video() {
-        if (!mpv || !is_paused) return;
-
-        if (mpv_gl) {
-            mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, this);
+        if (self->args.preload_mb > 0) {
+            memory_source::load(self->args.video_path, self->args.preload_mb);
         }
 
-        mpv_set_property_string(mpv, "pause", "no");
-        is_paused = false;
-
-        if (render_timer_id == 0) {
-            render_timer_id = g_timeout_add(16, on_render_timer, this);
-        }
-        std::cout << "Video resumed" << std::endl;
-    }
-
-private:
-    void setup_window() {
-        window = GTK_WINDOW(gtk_application_window_new(app));
-        gtk_window_set_title(window, "vidwall");
-
-        gtk_layer_init_for_window(window);
-        gtk_layer_set_layer(window, GTK_LAYER_SHELL_LAYER_BACKGROUND);
-        gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_LEFT, TRUE);
-        gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_RIGHT, TRUE);
-        gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_TOP, TRUE);
-        gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_BOTTOM, TRUE);
-        gtk_layer_set_exclusive_zone(window, -1);
-
-        gl_area = gtk_gl_area_new();
-        gtk_gl_area_set_required_version(GTK_GL_AREA(gl_area), 2, 1);
-        gtk_gl_area_set_auto_render(GTK_GL_AREA(gl_area), FALSE);
-
-        g_signal_connect(gl_area, "realize", G_CALLBACK(on_gl_realize), this);
-        g_signal_connect(gl_area, "render", G_CALLBACK(on_gl_render), this);
-        g_signal_connect(gl_area, "unrealize", G_CALLBACK(on_gl_unrealize), this);
-
-        gtk_window_set_child(window, gl_area);
-        gtk_window_present(window);
-
-        std::cout << "Window ready" << std::endl;
-    }
-
-    void setup_mpv() {
-        mpv = mpv_create();
-        if (!mpv) {
-            std::cerr << "Failed to create mpv" << std::endl;
-            return;
-        }
-
-        mpv_set_option_string(mpv, "vo", "libmpv");
-        mpv_set_option_string(mpv, "hwdec", args.no_hwdec ? "no" : "auto");
-        mpv_set_option_string(mpv, "loop-file", args.loop ? "inf" : "no");
-        mpv_set_option_string(mpv, "audio", args.mute ? "no" : "yes");
-        if (!args.mute) {
-            mpv_set_option_string(mpv, "volume", "50");
-        }
-
-        mpv_set_option_string(mpv, "video-sync", args.mute ? "display-vdrop" : "audio");
-        mpv_set_option_string(mpv, "opengl-swapinterval", "0");
-        mpv_set_option_string(mpv, "scale", "bilinear");
-        mpv_set_option_string(mpv, "dscale", "bilinear");
-        mpv_set_option_string(mpv, "cscale", "bilinear");
-        mpv_set_option_string(mpv, "vd-lavc-dr", "yes");
-        mpv_set_option_string(mpv, "vd-lavc-threads", "0");
-        mpv_set_option_string(mpv, "background", "none");
-
-        if (!args.no_downscale) {
-            mpv_set_option_string(mpv, "vf", "scale=w=1920:h=-1");
+        if (self->args.backend != "gtk") {
+            bool software = self->args.backend == "software";
+            auto connection = std::make_unique<WaylandConnection>();
+            if (connection->connect(!software)) {
+                self->wayland = std::move(connection);
+                std::cout << "Backend: direct layer surfaces"
+                          << (software ? " (software rendering)" : "") << std::endl;
+            } else {
+                std::cerr << "Direct Wayland backend unavailable, using GTK" << std::endl;
+            }
         }
 
-        if (mpv_initialize(mpv) < 0) {
-            std::cerr << "Failed to initialize mpv" << std::endl;
-            return;
+        // Offscreen frames are drawn through GTK's GL contexts
+        if (self->wayland && (self->args.shared_decoder || self->args.render_thread)) {
+            std::cout << "--shared-decoder and --render-thread ignored with --backend "
+                      << self->args.backend << std::endl;
+        } else if (self->args.shared_decoder) {
+            auto decoder = std::make_unique<OffscreenDecoder>(self->args, "shared");
+            if (decoder->start(gdk_display_get_default(), self->args.render_thread)) {
+                self->shared_decoder = std::move(decoder);
+                if (self->args.deep_pause_s > 0) {
+                    std::cout << "--deep-pause-after ignored with --shared-decoder" << std::endl;
+                }
+            } else {
+                std::cerr << "Shared decoder unavailable, decoding per monitor" << std::endl;
+            }
         }
 
-        std::cout << "MPV ready" << std::endl;
-        if (!args.mute) std::cout << "  Audio: enabled (50% volume)" << std::endl;
-        if (args.loop) std::cout << "  Loop: enabled" << std::endl;
-    }
-
-    void setup_gl_rendering() {
-        gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
+        self->monitor_list = gdk_display_get_monitors(gdk_display_get_default());
+        self->monitors_changed_id = g_signal_connect(self->monitor_list, "items-changed",
+                                                     G_CALLBACK(on_monitors_changed), self);
+        self->sync_outputs();
 
-        if (gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) != nullptr) {
-            std::cerr << "GL error" << std::endl;
+        if (self->outputs.empty()) {
+            std::cerr << "Fatal: no output could be set up, cannot continue" << std::endl;
+            g_application_quit(G_APPLICATION(self->app));
             return;
         }
 
-        mpv_opengl_init_params gl_init_params{
-            .get_proc_address = get_proc_address,
-            .get_proc_address_ctx = nullptr
-        };
-
-        mpv_render_param params[]{
-            {MPV_RENDER_PARAM_API_TYPE, const_cast<char*>(MPV_RENDER_API_TYPE_OPENGL)},
-            {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &gl_init_params},
-            {MPV_RENDER_PARAM_INVALID, nullptr}
-        };
-
-        if (mpv_render_context_create(&mpv_gl, mpv, params) < 0) {
-            std::cerr << "Render context failed" << std::endl;
-            return;
+        // mpv events arrive through each output's wakeup fd; without --stats
+        // nothing wakes the main loop periodically
+        if (self->args.stats) {
+            self->stats_timer_id = g_timeout_add(5000, on_stats_timer, self);
         }
-
-        mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, this);
-
-        std::cout << "GL rendering ready (60 FPS)" << std::endl;
-    }
-
-    void load_video() {
-        if (!mpv) return;
-        const char *cmd[] = {"loadfile", args.video_path.c_str(), nullptr};
-        mpv_command_async(mpv, 0, cmd);
-        std::cout << "Loading: " << args.video_path << std::endl;
     }
 
-    static void on_gl_realize(GtkGLArea *area, gpointer user_data) {
-        (void)area; (void)user_data;
-    }
-
-    static gboolean on_gl_render(GtkGLArea *area, GdkGLContext *context, gpointer user_data) {
-        auto *self = static_cast<HyprVidWall*>(user_data);
-        (void)context;
+public:
+    std::unordered_map<std::string, guint> pending_visibility_changes;   // monitor -> idle source
+    std::unordered_map<std::string, guint> pending_prewarms;             // monitor -> idle source
+    std::mutex visibility_mutex;
 
-        if (!self->mpv_gl) return FALSE;
+    // Pauses, slows down or resumes the wallpaper on one monitor
+    void apply_visibility(const std::string& monitor, Visibility visibility) {
+        monitor_visibility[monitor] = visibility;
 
-        if (self->is_paused.load(std::memory_order_relaxed)) {
-            return TRUE;
+        for (auto& output : outputs) {
+            if (output->get_name() == monitor) {
+                output->set_visibility(effective_visibility(visibility));
+            }
         }
-
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        int width = gtk_widget_get_width(GTK_WIDGET(area));
-        int height = gtk_widget_get_height(GTK_WIDGET(area));
-
-        int fbo = 0;
-        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
-
-        mpv_opengl_fbo mpv_fbo{
-            .fbo = fbo,
-            .w = width,
-            .h = height,
-            .internal_format = 0
-        };
-
-        int flip_y = 1;
-        int block = 0;
-
-        mpv_render_param render_params[]{
-            {MPV_RENDER_PARAM_OPENGL_FBO, &mpv_fbo},
-            {MPV_RENDER_PARAM_FLIP_Y, &flip_y},
-            {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &block},
-            {MPV_RENDER_PARAM_INVALID, nullptr}
-        };
-
-        mpv_render_context_render(self->mpv_gl, render_params);
-
-        return TRUE;
     }
 
-    static void on_gl_unrealize(GtkGLArea *area, gpointer user_data) {
-        (void)area;
-        auto *self = static_cast<HyprVidWall*>(user_data);
-
-        if (self->render_timer_id > 0) {
-            g_source_remove(self->render_timer_id);
-            self->render_timer_id = 0;
-        }
-        if (self->event_timer_id > 0) {
-            g_source_remove(self->event_timer_id);
-            self->event_timer_id = 0;
-        }
-
-        gtk_gl_area_make_current(GTK_GL_AREA(self->gl_area));
-
-        if (self->mpv_gl) {
-            mpv_render_context_free(self->mpv_gl);
-            self->mpv_gl = nullptr;
+    // Starts decoding on a monitor that is about to be revealed
+    void apply_prewarm(const std::string& monitor) {
+        for (auto& output : outputs) {
+            if (output->get_name() == monitor) {
+                output->prewarm();
+            }
         }
     }
 
-public:
     HyprVidWall(const CliArgs& cli_args)
-        : mpv(nullptr), mpv_gl(nullptr), render_timer_id(0), event_timer_id(0),
-          stats_timer_id(0), is_paused(false), args(cli_args),
-          pending_resize_id(0), pending_focus_change_id(0) {
+        : stats_timer_id(0), args(cli_args) {
         app = gtk_application_new("com.hyprvidwall.app", G_APPLICATION_NON_UNIQUE);
         g_signal_connect(app, "activate", G_CALLBACK(on_activate), this);
     }
 
     ~HyprVidWall() {
-        if (render_timer_id > 0) g_source_remove(render_timer_id);
-        if (event_timer_id > 0) g_source_remove(event_timer_id);
+        // No more visibility changes can be queued once IPC is stopped
+        hypr_ipc.stop_listening();
+
         if (stats_timer_id > 0) g_source_remove(stats_timer_id);
-        if (pending_resize_id > 0) g_source_remove(pending_resize_id);
+        if (ipc_socket_watch_id > 0) g_source_remove(ipc_socket_watch_id);
+        if (ipc_timer_watch_id > 0) g_source_remove(ipc_timer_watch_id);
+        if (ipc_poll_watch_id > 0) g_source_remove(ipc_poll_watch_id);
+        if (monitors_changed_id > 0) g_signal_handler_disconnect(monitor_list, monitors_changed_id);
 
         {
-            std::lock_guard<std::mutex> lock(focus_mutex);
-            if (pending_focus_change_id > 0) {
-                g_source_remove(pending_focus_change_id);
-                pending_focus_change_id = 0;
+            std::lock_guard<std::mutex> lock(visibility_mutex);
+            for (auto& [monitor, id] : pending_visibility_changes) {
+                g_source_remove(id);
             }
+            pending_visibility_changes.clear();
+            for (auto& [monitor, id] : pending_prewarms) {
+                g_source_remove(id);
+            }
+            pending_prewarms.clear();
         }
 
-        if (mpv) {
-            mpv_terminate_destroy(mpv);
-            mpv = nullptr;
-        }
+        outputs.clear();
+        shared_decoder.reset();
+        wayland.reset();
+        memory_source::unload();
         g_object_unref(app);
     }
 
     int run() {
+        // --optimize can take minutes; done before the application starts,
+        // ahead of IPC and the lock watch, whose events would pile up. The
+        // monitors' sizes need GDK, which the application then reuses.
+        gtk_init();
+        select_optimized_copy();
+
         char *dummy_argv[] = {(char*)"vidwall", nullptr};
         return g_application_run(G_APPLICATION(app), 1, dummy_argv);
     }
 };
 
-// Marshal focus change from IPC thread to GTK main thread
-static gboolean on_focus_changed_main_thread(gpointer user_data) {
-    auto *data = static_cast<FocusChangeData*>(user_data);
+// Marshal visibility change from IPC thread to GTK main thread
+static gboolean on_visibility_changed_main_thread(gpointer user_data) {
+    auto *data = static_cast<VisibilityChangeData*>(user_data);
 
     {
-        std::lock_guard<std::mutex> lock(*(data->mutex));
-        *(data->pending_id) = 0;
+        std::lock_guard<std::mutex> lock(data->self->visibility_mutex);
+        data->self->pending_visibility_changes.erase(data->monitor);
     }
 
-    if (data->has_focus) {
-        data->self->pause_video();
-    } else {
-        data->self->resume_video();
-    }
+    data->self->apply_visibility(data->monitor, data->visibility);
 
     return G_SOURCE_REMOVE;
 }
 
-static void on_focus_changed(bool has_focus, HyprVidWall *self) {
-    std::lock_guard<std::mutex> lock(self->focus_mutex);
+static void on_visibility_changed(const std::string& monitor, Visibility visibility, HyprVidWall *self) {
+    std::lock_guard<std::mutex> lock(self->visibility_mutex);
 
-    if (self->pending_focus_change_id > 0) {
-        g_source_remove(self->pending_focus_change_id);
-        self->pending_focus_change_id = 0;
+    // Only the latest decision per monitor matters
+    auto pending = self->pending_visibility_changes.find(monitor);
+    if (pending != self->pending_visibility_changes.end()) {
+        g_source_remove(pending->second);
+        self->pending_visibility_changes.erase(pending);
     }
 
-    auto *data = new FocusChangeData{self, has_focus, &(self->pending_focus_change_id), &(self->focus_mutex)};
+    auto *data = new VisibilityChangeData{self, monitor, visibility};
+
+    self->pending_visibility_changes[monitor] = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+        on_visibility_changed_main_thread,
+        data,
+        [](gpointer user_data) {
+            delete static_cast<VisibilityChangeData*>(user_data);
+        }
+    );
+}
+
+static gboolean on_prewarm_main_thread(gpointer user_data) {
+    auto *data = static_cast<PrewarmData*>(user_data);
+
+    {
+        std::lock_guard<std::mutex> lock(data->self->visibility_mutex);
+        data->self->pending_prewarms.erase(data->monitor);
+    }
+
+    data->self->apply_prewarm(data->monitor);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void on_prewarm_requested(const std::string& monitor, HyprVidWall *self) {
+    std::lock_guard<std::mutex> lock(self->visibility_mutex);
+
+    // One queued prewarm per monitor is enough
+    if (self->pending_prewarms.count(monitor)) return;
+
+    auto *data = new PrewarmData{self, monitor};
 
-    self->pending_focus_change_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
-        on_focus_changed_main_thread,
+    // Ahead of queued visibility changes, the point is to start early
+    self->pending_prewarms[monitor] = g_idle_add_full(G_PRIORITY_DEFAULT,
+        on_prewarm_main_thread,
         data,
         [](gpointer user_data) {
-            delete static_cast<FocusChangeData*>(user_data);
+            delete static_cast<PrewarmData*>(user_data);
         }
     );
 }
@@ -0,0 +1,138 @@
+#include "../include/memory_source.h"
+#include <mpv/stream_cb.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace memory_source {
+
+static constexpr const char *PROTOCOL = "vidwall-mem";
+
+static std::unique_ptr<char[]> data;
+static uint64_t size = 0;
+static std::string uri;
+
+// Bumped from mpv's demuxer threads
+static std::atomic<uint64_t> opens{0};
+static std::atomic<uint64_t> reads{0};
+static std::atomic<uint64_t> seeks{0};
+static std::atomic<uint64_t> bytes{0};
+
+// One per opened stream, mpv opens it again for every loop
+struct Cookie {
+    uint64_t position = 0;
+};
+
+static int64_t on_read(void *cookie, char *buf, uint64_t nbytes) {
+    auto *stream = static_cast<Cookie*>(cookie);
+    uint64_t n = std::min(nbytes, size - stream->position);
+    memcpy(buf, data.get() + stream->position, n);
+    stream->position += n;
+    reads.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(n, std::memory_order_relaxed);
+    return static_cast<int64_t>(n);
+}
+
+static int64_t on_seek(void *cookie, int64_t offset) {
+    if (offset < 0 || static_cast<uint64_t>(offset) > size) return MPV_ERROR_GENERIC;
+    static_cast<Cookie*>(cookie)->position = static_cast<uint64_t>(offset);
+    seeks.fetch_add(1, std::memory_order_relaxed);
+    return offset;
+}
+
+static int64_t on_size(void *cookie) {
+    (void)cookie;
+    return static_cast<int64_t>(size);
+}
+
+static void on_close(void *cookie) {
+    delete static_cast<Cookie*>(cookie);
+}
+
+static int on_open(void *user_data, char *requested_uri, mpv_stream_cb_info *info) {
+    (void)user_data;
+    if (!data || uri != requested_uri) return MPV_ERROR_LOADING_FAILED;
+
+    info->cookie = new Cookie();
+    info->read_fn = on_read;
+    info->seek_fn = on_seek;
+    info->size_fn = on_size;
+    info->close_fn = on_close;
+    opens.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+bool load(const std::string& path, int limit_mb) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Preload: cannot open " << path << std::endl;
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        std::cerr << "Preload: " << path << " is not a regular file, reading from disk" << std::endl;
+        close(fd);
+        return false;
+    }
+    uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    if (file_size > static_cast<uint64_t>(limit_mb) * 1024 * 1024) {
+        std::cout << "Preload: " << file_size / (1024 * 1024) << " MB exceeds the " << limit_mb
+                  << " MB limit, reading from disk" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    auto buffer = std::make_unique<char[]>(file_size);
+    uint64_t done = 0;
+    while (done < file_size) {
+        ssize_t n = read(fd, buffer.get() + done, file_size - done);
+        if (n <= 0) {
+            std::cerr << "Preload: reading " << path << " failed, reading from disk" << std::endl;
+            close(fd);
+            return false;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+    close(fd);
+
+    data = std::move(buffer);
+    size = file_size;
+    // The file name stays at the end, for demuxers that go by extension
+    std::string::size_type slash = path.rfind('/');
+    uri = std::string(PROTOCOL) + "://" + (slash == std::string::npos ? path : path.substr(slash + 1));
+
+    std::cout << "Preload: " << (size + 512 * 1024) / (1024 * 1024) << " MB held in memory" << std::endl;
+    return true;
+}
+
+void unload() {
+    data.reset();
+    size = 0;
+    uri.clear();
+}
+
+std::string register_protocol(mpv_handle *mpv, const std::string& path) {
+    if (!data) return path;
+    if (mpv_stream_cb_add_ro(mpv, PROTOCOL, nullptr, on_open) < 0) {
+        std::cerr << "Preload: mpv refused the stream protocol, reading from disk" << std::endl;
+        return path;
+    }
+    return uri;
+}
+
+Stats take_stats() {
+    Stats stats;
+    stats.opens = opens.exchange(0, std::memory_order_relaxed);
+    stats.reads = reads.exchange(0, std::memory_order_relaxed);
+    stats.seeks = seeks.exchange(0, std::memory_order_relaxed);
+    stats.bytes = bytes.exchange(0, std::memory_order_relaxed);
+    return stats;
+}
+
+}
@@ -0,0 +1,123 @@
+#include "../include/mpv_config.h"
+#include <algorithm>
+#include <string>
+
+const char *hwdec_mode(const CliArgs& args) {
+    // mpdecimate compares pixels, decoded frames have to come back to system
+    // memory; the software renderer is meant for machines without a GPU
+    if (args.no_hwdec || args.backend == "software") return "no";
+    if (args.skip_static) return "auto-copy";
+    return "auto";
+}
+
+void apply_mpv_options(mpv_handle *mpv, const CliArgs& args) {
+    mpv_set_option_string(mpv, "vo", "libmpv");
+    mpv_set_option_string(mpv, "hwdec", hwdec_mode(args));
+    mpv_set_option_string(mpv, "loop-file", args.loop ? "inf" : "no");
+    mpv_set_option_string(mpv, "audio", args.mute ? "no" : "yes");
+    if (!args.mute) {
+        mpv_set_option_string(mpv, "volume", "50");
+    }
+
+    // Frames are timed against the clock (or the audio) and each one
+    // reaches the render API once. Display sync would repeat frames at the
+    // display rate, so renders would track vsync instead of the content.
+    mpv_set_option_string(mpv, "video-sync", "audio");
+    mpv_set_option_string(mpv, "opengl-swapinterval", "0");
+    mpv_set_option_string(mpv, "scale", "bilinear");
+    mpv_set_option_string(mpv, "dscale", "bilinear");
+    mpv_set_option_string(mpv, "cscale", "bilinear");
+    mpv_set_option_string(mpv, "vd-lavc-dr", "yes");
+    mpv_set_option_string(mpv, "vd-lavc-threads", "0");
+    if (args.opaque) {
+        // Letterbox bars in solid black, so the surface can be declared opaque
+        mpv_set_option_string(mpv, "background", "color");
+        mpv_set_option_string(mpv, "background-color", "#000000");
+    } else {
+        mpv_set_option_string(mpv, "background", "none");
+    }
+
+    // Decimate right after the decoder, so scaling and upload only see kept frames.
+    // mpdecimate drops frames that barely differ from the last kept one; mpv
+    // then simply shows that frame longer, so nothing is rendered or committed.
+    // The --fps filter goes in front of it once the source rate is known.
+    if (args.skip_static) {
+        mpv_set_option_string(mpv, "vf", "mpdecimate");
+    }
+}
+
+bool apply_fps_cap(mpv_handle *mpv, int fps, double& source_fps) {
+    source_fps = 0.0;
+    mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &source_fps);
+    if (source_fps <= fps) return false;
+
+    std::string filter = "@vidwall-fps:fps=fps=" + std::to_string(fps);
+    const char *cmd[] = {"vf", "pre", filter.c_str(), nullptr};
+    return mpv_command(mpv, cmd) >= 0;
+}
+
+bool enable_decoder_skip(mpv_handle *mpv, int fps, double& source_fps) {
+    source_fps = 0.0;
+    mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &source_fps);
+    if (source_fps < 2.0 * fps) return false;
+
+    mpv_set_property_string(mpv, "vd-lavc-skipframe", "nonref");
+    const char *cmd[] = {"video-reload", nullptr};
+    if (mpv_command(mpv, cmd) < 0) {
+        mpv_set_property_string(mpv, "vd-lavc-skipframe", "default");
+        return false;
+    }
+    return true;
+}
+
+const char *downscale_path_name(DownscalePath path) {
+    switch (path) {
+    case DownscalePath::None: return "none";
+    case DownscalePath::Hardware: return "hardware";
+    case DownscalePath::Gpu: return "gpu";
+    case DownscalePath::Software: return "software";
+    }
+    return "none";
+}
+
+// libavfilter scalers that take the hwdec's frames as they are
+static const char *hw_scaler(const std::string& hwdec) {
+    if (hwdec == "vaapi") return "scale_vaapi";
+    if (hwdec == "nvdec" || hwdec == "cuda") return "scale_cuda";
+    if (hwdec == "vulkan") return "scale_vulkan";
+    return nullptr;   // "-copy" modes and software decoding end up in system memory
+}
+
+DownscalePath apply_downscale(mpv_handle *mpv, const CliArgs& args, int target_width, int target_height,
+                              bool gpu_renderer, int& fit_width, int& fit_height) {
+    int64_t video_width = 0, video_height = 0;
+    mpv_get_property(mpv, "width", MPV_FORMAT_INT64, &video_width);
+    mpv_get_property(mpv, "height", MPV_FORMAT_INT64, &video_height);
+    fit_width = static_cast<int>(video_width);
+    fit_height = static_cast<int>(video_height);
+    if (video_width <= 0 || video_height <= 0 || target_width <= 0 || target_height <= 0) {
+        return DownscalePath::None;
+    }
+
+    double fit = std::min(static_cast<double>(target_width) / video_width,
+                          static_cast<double>(target_height) / video_height);
+    if (args.no_downscale || fit >= 1.0) return DownscalePath::None;
+
+    // Even sizes, chroma is subsampled in hardware surfaces
+    fit_width = std::max(2, static_cast<int>(video_width * fit) & ~1);
+    fit_height = std::max(2, static_cast<int>(video_height * fit) & ~1);
+
+    char *current = mpv_get_property_string(mpv, "hwdec-current");
+    std::string hwdec = current ? current : "no";
+    mpv_free(current);
+
+    const char *scaler = hw_scaler(hwdec);
+    if (scaler) {
+        std::string filter = std::string("@vidwall-downscale:") + scaler + "=w=" + std::to_string(fit_width) +
+                             ":h=" + std::to_string(fit_height);
+        const char *cmd[] = {"vf", "add", filter.c_str(), nullptr};
+        if (mpv_command(mpv, cmd) >= 0) return DownscalePath::Hardware;
+    }
+
+    return gpu_renderer ? DownscalePath::Gpu : DownscalePath::Software;
+}
@@ -0,0 +1,638 @@
+#include "../include/offscreen_decoder.h"
+#include "../include/wallpaper_output.h"
+#include "../include/mpv_config.h"
+#include "../include/memory_source.h"
+#include <glib-unix.h>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+OffscreenDecoder::OffscreenDecoder(const CliArgs& args, const std::string& label)
+    : args(args), label(label) {}
+
+OffscreenDecoder::~OffscreenDecoder() {
+    if (wakeup_watch_id > 0) {
+        g_source_remove(wakeup_watch_id);
+        wakeup_watch_id = 0;
+    }
+
+    // The render context goes before mpv, on the thread its GL context is current in
+    if (render_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping = true;
+        }
+        wake_cv.notify_one();
+        render_thread.join();
+    } else if (gl_context) {
+        gdk_gl_context_make_current(gl_context);
+        if (mpv_gl) {
+            mpv_render_context_free(mpv_gl);
+            mpv_gl = nullptr;
+        }
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        free_slots();
+        gdk_gl_context_clear_current();
+    }
+    if (thread_egl_context != EGL_NO_CONTEXT) {
+        eglDestroyContext(thread_egl_display, thread_egl_context);
+        thread_egl_context = EGL_NO_CONTEXT;
+    }
+    g_clear_object(&gl_context);
+
+    if (mpv) {
+        mpv_set_wakeup_callback(mpv, nullptr, nullptr);
+        mpv_terminate_destroy(mpv);
+        mpv = nullptr;
+    }
+
+    if (wakeup_fd >= 0) {
+        close(wakeup_fd);
+        wakeup_fd = -1;
+    }
+
+    while (g_idle_remove_by_data(this)) {}
+}
+
+void *OffscreenDecoder::get_proc_address(void *ctx, const char *name) {
+    (void)ctx;
+    return (void *)eglGetProcAddress(name);
+}
+
+bool OffscreenDecoder::start(GdkDisplay *display, bool render_thread_requested) {
+    if (!setup_gl_context(display) || !setup_mpv()) return false;
+    use_thread = render_thread_requested && setup_thread_context();
+
+    mpv_opengl_init_params gl_init_params{
+        .get_proc_address = get_proc_address,
+        .get_proc_address_ctx = nullptr
+    };
+
+    mpv_render_param params[]{
+        {MPV_RENDER_PARAM_API_TYPE, const_cast<char*>(MPV_RENDER_API_TYPE_OPENGL)},
+        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &gl_init_params},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    // mpv's GL objects live in the context it renders with. The thread's
+    // is borrowed here and released before the thread takes it; GDK is told
+    // first, it remembers what it made current.
+    if (use_thread) {
+        gdk_gl_context_clear_current();
+        eglMakeCurrent(thread_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, thread_egl_context);
+    } else {
+        gdk_gl_context_make_current(gl_context);
+    }
+    bool created = mpv_render_context_create(&mpv_gl, mpv, params) >= 0;
+    if (use_thread) {
+        eglMakeCurrent(thread_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    if (!created) {
+        mpv_gl = nullptr;
+        std::cerr << "[" << label << "] Render context failed" << std::endl;
+        if (!use_thread) gdk_gl_context_clear_current();
+        use_thread = false;
+        return false;
+    }
+
+    mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, this);
+    if (use_thread) {
+        render_thread = std::thread(&OffscreenDecoder::render_loop, this);
+    }
+
+    const char *cmd[] = {"loadfile", video_location.c_str(), nullptr};
+    mpv_command_async(mpv, 0, cmd);
+    std::cout << "[" << label << "] Loading: " << args.video_path
+              << (video_location != args.video_path ? " (from memory)" : "")
+              << (use_thread ? " (render thread)" : "") << std::endl;
+    return true;
+}
+
+// A surfaceless context in the display's share group; textures made here
+// can be blitted from every GL area
+bool OffscreenDecoder::setup_gl_context(GdkDisplay *display) {
+    GError *error = nullptr;
+    gl_context = gdk_display_create_gl_context(display, &error);
+    if (gl_context && !gdk_gl_context_realize(gl_context, &error)) {
+        g_clear_object(&gl_context);
+    }
+    if (!gl_context) {
+        std::cerr << "[" << label << "] No GL context: " << (error ? error->message : "unknown error") << std::endl;
+        g_clear_error(&error);
+        return false;
+    }
+
+    gdk_gl_context_make_current(gl_context);
+
+    // Rendering into textures and blitting them out needs framebuffer objects
+    bool has_fbo = epoxy_gl_version() >= 30 || epoxy_has_gl_extension("GL_ARB_framebuffer_object");
+    has_sync = epoxy_gl_version() >= 32 || epoxy_has_gl_extension("GL_ARB_sync");
+    gdk_gl_context_clear_current();
+
+    if (!has_fbo) {
+        std::cerr << "[" << label << "] Framebuffer objects not supported" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The render thread's context: plain EGL, sharing with gl_context and so
+// with every GL area, with the same API, version and profile. GDK keeps
+// the current GdkGLContext per thread but creates and realizes contexts
+// through the display, which is not thread safe, so none of its contexts
+// is made current off the main thread. False if GDK does not use EGL
+// (GLX on X11) or the context cannot be created; frames are then rendered
+// on the main thread.
+bool OffscreenDecoder::setup_thread_context() {
+    gdk_gl_context_make_current(gl_context);
+    EGLDisplay egl_display = eglGetCurrentDisplay();
+    EGLContext share = eglGetCurrentContext();
+    if (egl_display == EGL_NO_DISPLAY || share == EGL_NO_CONTEXT) {
+        gdk_gl_context_clear_current();
+        std::cerr << "[" << label << "] GDK is not using EGL, rendering on the main thread" << std::endl;
+        return false;
+    }
+
+    // GDK creates config-less contexts where EGL_KHR_no_config_context is
+    // there; their config id is 0
+    EGLint config_id = 0, client_type = EGL_OPENGL_API;
+    eglQueryContext(egl_display, share, EGL_CONFIG_ID, &config_id);
+    eglQueryContext(egl_display, share, EGL_CONTEXT_CLIENT_TYPE, &client_type);
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (config_id != 0) {
+        EGLint config_attribs[] = {EGL_CONFIG_ID, config_id, EGL_NONE};
+        EGLint count = 0;
+        if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &count) || count < 1) {
+            config = EGL_NO_CONFIG_KHR;
+        }
+    }
+
+    int major = 0, minor = 0;
+    gdk_gl_context_get_version(gl_context, &major, &minor);
+    std::vector<EGLint> attribs = {EGL_CONTEXT_MAJOR_VERSION, major, EGL_CONTEXT_MINOR_VERSION, minor};
+    if (client_type == EGL_OPENGL_API) {
+        attribs.push_back(EGL_CONTEXT_OPENGL_PROFILE_MASK);
+        attribs.push_back(gdk_gl_context_is_legacy(gl_context) ? EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT
+                                                               : EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT);
+    }
+    attribs.push_back(EGL_NONE);
+
+    eglBindAPI(client_type);
+    EGLContext context = eglCreateContext(egl_display, config, share, attribs.data());
+    gdk_gl_context_clear_current();
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "[" << label << "] No EGL context for the render thread (0x" << std::hex << eglGetError()
+                  << std::dec << "), rendering on the main thread" << std::endl;
+        return false;
+    }
+
+    thread_egl_display = egl_display;
+    thread_egl_context = context;
+    thread_egl_api = client_type;
+    return true;
+}
+
+bool OffscreenDecoder::setup_mpv() {
+    mpv = mpv_create();
+    if (!mpv) {
+        std::cerr << "Failed to create mpv" << std::endl;
+        return false;
+    }
+
+    apply_mpv_options(mpv, args);
+
+    // Nothing is active until an output attaches
+    mpv_set_option_string(mpv, "pause", "yes");
+
+    // Reloaded after a deep pause
+    if (start_position > 0.0) {
+        mpv_set_option_string(mpv, "start", std::to_string(start_position).c_str());
+    }
+
+    if (mpv_initialize(mpv) < 0) {
+        std::cerr << "Failed to initialize mpv" << std::endl;
+        mpv_terminate_destroy(mpv);
+        mpv = nullptr;
+        return false;
+    }
+
+    video_location = memory_source::register_protocol(mpv, args.video_path);
+
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd < 0) {
+        std::cerr << "Failed to create mpv wakeup fd" << std::endl;
+        return false;
+    }
+    wakeup_watch_id = g_unix_fd_add(wakeup_fd, G_IO_IN, on_mpv_wakeup_ready, this);
+    mpv_set_wakeup_callback(mpv, on_mpv_wakeup, this);
+
+    std::cout << "[" << label << "] MPV ready (offscreen)" << std::endl;
+    return true;
+}
+
+void OffscreenDecoder::on_mpv_wakeup(void *ctx) {
+    auto *self = static_cast<OffscreenDecoder*>(ctx);
+    uint64_t one = 1;
+    ssize_t n = write(self->wakeup_fd, &one, sizeof(one));
+    (void)n;
+}
+
+gboolean OffscreenDecoder::on_mpv_wakeup_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    (void)condition;
+    auto *self = static_cast<OffscreenDecoder*>(user_data);
+
+    uint64_t count;
+    ssize_t n = read(fd, &count, sizeof(count));
+    (void)n;
+
+    self->handle_mpv_events();
+    return G_SOURCE_CONTINUE;
+}
+
+void OffscreenDecoder::handle_mpv_events() {
+    while (mpv) {
+        mpv_event *event = mpv_wait_event(mpv, 0);
+        if (event->event_id == MPV_EVENT_NONE) break;
+
+        if (event->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = (mpv_event_end_file *)event->data;
+            if (ef->reason == MPV_END_FILE_REASON_ERROR) {
+                std::cerr << "[" << label << "] Error, reloading..." << std::endl;
+                const char *cmd[] = {"loadfile", video_location.c_str(), nullptr};
+                mpv_command_async(mpv, 0, cmd);
+            }
+        } else if (event->event_id == MPV_EVENT_FILE_LOADED) {
+            std::cout << "[" << label << "] Video loaded" << std::endl;
+
+            mpv_get_property(mpv, "width", MPV_FORMAT_INT64, &video_width);
+            mpv_get_property(mpv, "height", MPV_FORMAT_INT64, &video_height);
+            if (video_width > 0 && video_height > 0) {
+                for (WallpaperOutput *output : outputs) {
+                    output->set_video_size(video_width, video_height);
+                }
+            }
+
+            if (args.fps > 0 && !decoder_skip_checked) {
+                decoder_skip_checked = true;
+                double source_fps = 0.0;
+                if (!apply_fps_cap(mpv, args.fps, source_fps)) {
+                    std::cout << "[" << label << "] Source " << source_fps << " fps, not above --fps "
+                              << args.fps << ", left uncapped" << std::endl;
+                }
+                decoder_skip = enable_decoder_skip(mpv, args.fps, source_fps);
+                if (decoder_skip) {
+                    std::cout << "[" << label << "] Source " << source_fps
+                              << " fps, decoder skips non-reference frames" << std::endl;
+                }
+            }
+        } else if (event->event_id == MPV_EVENT_PLAYBACK_RESTART) {
+            // Loops restart from "start" too, only the first pass resumes
+            if (start_position > 0.0) {
+                start_position = -1.0;
+                mpv_set_property_string(mpv, "start", "none");
+            }
+        } else if (event->event_id == MPV_EVENT_VIDEO_RECONFIG) {
+            // Fitted to the largest monitor attached; hwdec-current is known from here
+            if (!downscale_checked && !outputs.empty()) {
+                downscale_checked = true;
+                int target_width = 0, target_height = 0;
+                for (WallpaperOutput *output : outputs) {
+                    int output_width = 0, output_height = 0;
+                    output->monitor_pixel_size(output_width, output_height);
+                    target_width = std::max(target_width, output_width);
+                    target_height = std::max(target_height, output_height);
+                }
+                downscale = apply_downscale(mpv, args, target_width, target_height, true,
+                                            downscale_width, downscale_height);
+                std::cout << "[" << label << "] Downscale for " << target_width << "x" << target_height
+                          << ": " << downscale_path_name(downscale) << " (" << downscale_width << "x"
+                          << downscale_height << ")" << std::endl;
+            }
+
+            // Size after the filter chain, or the fitted size when mpv
+            // scales while rendering; frames are rendered at this size
+            // once and scaled per output. The producer reallocates.
+            int64_t dwidth = 0, dheight = 0;
+            mpv_get_property(mpv, "dwidth", MPV_FORMAT_INT64, &dwidth);
+            mpv_get_property(mpv, "dheight", MPV_FORMAT_INT64, &dheight);
+            if (downscale == DownscalePath::Gpu && dwidth > downscale_width) {
+                dwidth = downscale_width;
+                dheight = downscale_height;
+            }
+            if (dwidth > 0 && dheight > 0) {
+                std::lock_guard<std::mutex> lock(frame_mutex);
+                requested_width = static_cast<int>(dwidth);
+                requested_height = static_cast<int>(dheight);
+            }
+        }
+    }
+}
+
+// From mpv's threads. Wakes the render thread, or collapses into one idle
+// on the main loop.
+void OffscreenDecoder::on_mpv_render_update(void *ctx) {
+    auto *self = static_cast<OffscreenDecoder*>(ctx);
+    if (self->use_thread) {
+        {
+            std::lock_guard<std::mutex> lock(self->wake_mutex);
+            self->update_pending = true;
+        }
+        self->wake_cv.notify_one();
+        return;
+    }
+    if (self->update_queued.exchange(true)) return;
+    g_idle_add_full(G_PRIORITY_HIGH_IDLE, on_render_update_idle, self, nullptr);
+}
+
+gboolean OffscreenDecoder::on_render_update_idle(gpointer user_data) {
+    auto *self = static_cast<OffscreenDecoder*>(user_data);
+    self->update_queued = false;
+    if (!self->mpv_gl) return G_SOURCE_REMOVE;
+
+    gdk_gl_context_make_current(self->gl_context);
+    self->render_update();
+    return G_SOURCE_REMOVE;
+}
+
+void OffscreenDecoder::render_loop() {
+    // The bound API is per thread
+    eglBindAPI(thread_egl_api);
+    eglMakeCurrent(thread_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, thread_egl_context);
+
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    for (;;) {
+        wake_cv.wait(lock, [this] { return stopping || update_pending; });
+        if (stopping) break;
+        update_pending = false;
+
+        lock.unlock();
+        render_update();
+        lock.lock();
+    }
+    lock.unlock();
+
+    mpv_render_context_free(mpv_gl);
+    mpv_gl = nullptr;
+    {
+        std::lock_guard<std::mutex> frame_lock(frame_mutex);
+        free_slots();
+    }
+    eglMakeCurrent(thread_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+}
+
+// Producer side, with gl_context current: renders a new frame into the
+// back slot and publishes it as ready
+void OffscreenDecoder::render_update() {
+    uint64_t flags = mpv_render_context_update(mpv_gl);
+    if (!(flags & MPV_RENDER_UPDATE_FRAME) || !running) return;
+
+    int slot;
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        if (requested_width != width || requested_height != height) {
+            reallocate_slots();
+        }
+        if (!textures[0]) return;
+
+        slot = back;
+        // Blits of this slot's previous frame have to finish first
+        for (GLsync fence : read_fences[slot]) {
+            glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+        }
+        read_fences[slot].clear();
+        if (render_fences[slot]) {
+            glDeleteSync(render_fences[slot]);
+            render_fences[slot] = nullptr;
+        }
+    }
+
+    mpv_opengl_fbo mpv_fbo{
+        .fbo = static_cast<int>(fbos[slot]),
+        .w = width,
+        .h = height,
+        .internal_format = GL_RGBA8
+    };
+    // Same orientation as rendering straight into a GL area, outputs blit it as is
+    int flip_y = 1;
+    int block = 0;
+    mpv_render_param render_params[]{
+        {MPV_RENDER_PARAM_OPENGL_FBO, &mpv_fbo},
+        {MPV_RENDER_PARAM_FLIP_Y, &flip_y},
+        {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &block},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    auto render_start = std::chrono::steady_clock::now();
+    mpv_render_context_render(mpv_gl, render_params);
+
+    // Other contexts only see the result once these commands are flushed
+    GLsync fence = nullptr;
+    if (has_sync) {
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    } else {
+        glFinish();
+    }
+    auto now = std::chrono::steady_clock::now();
+    uint64_t render_us = std::chrono::duration_cast<std::chrono::microseconds>(now - render_start).count();
+
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        render_fences[slot] = fence;
+        std::swap(back, ready);
+        if (ready_fresh) stats.superseded++;
+        ready_fresh = true;
+        ready_time = now;
+
+        stats.frames++;
+        render_total_us += render_us;
+        stats.max_render_ms = std::max(stats.max_render_ms, render_us / 1000.0);
+    }
+
+    if (!use_thread) {
+        notify_outputs();
+    } else if (!frame_notify_queued.exchange(true)) {
+        g_idle_add_full(G_PRIORITY_HIGH_IDLE, on_frame_ready_idle, this, nullptr);
+    }
+}
+
+gboolean OffscreenDecoder::on_frame_ready_idle(gpointer user_data) {
+    auto *self = static_cast<OffscreenDecoder*>(user_data);
+    self->frame_notify_queued = false;
+    self->notify_outputs();
+    return G_SOURCE_REMOVE;
+}
+
+void OffscreenDecoder::notify_outputs() {
+    for (WallpaperOutput *output : active) {
+        output->offscreen_frame_ready();
+    }
+}
+
+// Producer context current, frame_mutex held
+void OffscreenDecoder::reallocate_slots() {
+    free_slots();
+    width = requested_width;
+    height = requested_height;
+
+    glGenTextures(SLOTS, textures);
+    glGenFramebuffers(SLOTS, fbos);
+    for (int i = 0; i < SLOTS; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "[" << label << "] Frame texture " << width << "x" << height << " unusable" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            free_slots();
+            requested_width = requested_height = 0;   // don't retry every frame
+            return;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    generation++;
+    std::cout << "[" << label << "] Rendering frames at " << width << "x" << height << std::endl;
+}
+
+// Producer context current, frame_mutex held. Outputs may still have the
+// textures attached; GL keeps their storage until they let go.
+void OffscreenDecoder::free_slots() {
+    for (int i = 0; i < SLOTS; i++) {
+        if (render_fences[i]) glDeleteSync(render_fences[i]);
+        render_fences[i] = nullptr;
+        for (GLsync fence : read_fences[i]) glDeleteSync(fence);
+        read_fences[i].clear();
+    }
+    if (fbos[0]) glDeleteFramebuffers(SLOTS, fbos);
+    if (textures[0]) glDeleteTextures(SLOTS, textures);
+    std::fill(std::begin(fbos), std::end(fbos), 0);
+    std::fill(std::begin(textures), std::end(textures), 0);
+    back = 0;
+    ready = 1;
+    front = 2;
+    ready_fresh = false;
+    front_valid = false;
+    width = height = 0;
+}
+
+bool OffscreenDecoder::acquire_frame(Frame& frame) {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+
+    // Several outputs show the same frame; the first one after a new frame takes it
+    if (ready_fresh) {
+        std::swap(front, ready);
+        ready_fresh = false;
+        front_valid = true;
+
+        auto handoff = std::chrono::steady_clock::now() - ready_time;
+        uint64_t handoff_us = std::chrono::duration_cast<std::chrono::microseconds>(handoff).count();
+        handoffs++;
+        handoff_total_us += handoff_us;
+        stats.max_handoff_ms = std::max(stats.max_handoff_ms, handoff_us / 1000.0);
+    }
+    if (!front_valid) return false;
+
+    frame.slot = front;
+    std::copy(std::begin(textures), std::end(textures), std::begin(frame.textures));
+    frame.width = width;
+    frame.height = height;
+    frame.generation = generation;
+
+    if (render_fences[front]) {
+        glWaitSync(render_fences[front], 0, GL_TIMEOUT_IGNORED);
+    }
+    return true;
+}
+
+void OffscreenDecoder::release_frame(const Frame& frame) {
+    if (!has_sync) {
+        glFinish();
+        return;
+    }
+
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    if (frame.generation == generation) {
+        read_fences[frame.slot].push_back(fence);
+    } else {
+        glDeleteSync(fence);
+    }
+}
+
+void OffscreenDecoder::attach(WallpaperOutput *output) {
+    outputs.push_back(output);
+    if (video_width > 0 && video_height > 0) {
+        output->set_video_size(video_width, video_height);
+    }
+    if (!output->paused()) set_active(output, true);
+}
+
+void OffscreenDecoder::detach(WallpaperOutput *output) {
+    set_active(output, false);
+    std::erase(outputs, output);
+}
+
+void OffscreenDecoder::set_active(WallpaperOutput *output, bool is_active) {
+    bool was_running = !active.empty();
+    auto it = std::find(active.begin(), active.end(), output);
+    if (is_active && it == active.end()) {
+        active.push_back(output);
+    } else if (!is_active && it != active.end()) {
+        active.erase(it);
+    } else {
+        return;
+    }
+
+    running = !active.empty();
+    if (!mpv || running == was_running) return;
+
+    mpv_set_property_string(mpv, "pause", running ? "no" : "yes");
+    if (outputs.size() > 1) {
+        std::cout << "[" << label << "] Decoder " << (running ? "resumed" : "paused, no output needs frames") << std::endl;
+    }
+}
+
+double OffscreenDecoder::position() {
+    double seconds = 0.0;
+    if (!mpv || mpv_get_property(mpv, "time-pos", MPV_FORMAT_DOUBLE, &seconds) < 0) return -1.0;
+    return seconds;
+}
+
+void OffscreenDecoder::get_decode_rates(double& source_fps, double& filtered_fps) {
+    source_fps = 0.0;
+    filtered_fps = 0.0;
+    if (!mpv || !running) return;
+
+    mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &source_fps);
+    mpv_get_property(mpv, "estimated-vf-fps", MPV_FORMAT_DOUBLE, &filtered_fps);
+}
+
+OffscreenDecoder::Stats OffscreenDecoder::take_stats() {
+    int64_t drop_count = 0;
+    if (mpv) mpv_get_property(mpv, "frame-drop-count", MPV_FORMAT_INT64, &drop_count);
+
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    Stats result = stats;
+    result.avg_render_ms = result.frames > 0 ? render_total_us / 1000.0 / result.frames : 0.0;
+    result.avg_handoff_ms = handoffs > 0 ? handoff_total_us / 1000.0 / handoffs : 0.0;
+    // The counter restarts with every file load
+    result.late_drops = drop_count >= drop_count_snapshot ? drop_count - drop_count_snapshot : drop_count;
+    drop_count_snapshot = drop_count;
+
+    stats = Stats{};
+    render_total_us = 0;
+    handoff_total_us = 0;
+    handoffs = 0;
+    return result;
+}
@@ -0,0 +1,56 @@
+#include "../include/resource_usage.h"
+#include <epoxy/gl.h>
+#include <fstream>
+#include <string>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+namespace resource_usage {
+
+int64_t rss_kb() {
+    // statm: size resident shared text lib data dt, in pages
+    std::ifstream statm("/proc/self/statm");
+    int64_t size = 0, resident = 0;
+    if (!(statm >> size >> resident)) return -1;
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+int64_t free_vram_kb() {
+    if (epoxy_has_gl_extension("GL_NVX_gpu_memory_info")) {
+        GLint kb = 0;
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &kb);
+        return kb;
+    }
+    if (epoxy_has_gl_extension("GL_ATI_meminfo")) {
+        // total free, largest block, total auxiliary free, largest auxiliary block
+        GLint info[4] = {};
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, info);
+        return info[0];
+    }
+    return -1;
+}
+
+int64_t read_syscalls() {
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    int64_t value = 0;
+    while (io >> key >> value) {
+        if (key == "syscr:") return value;
+    }
+    return -1;
+}
+
+int64_t cpu_time_us() {
+    timespec ts{};
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return -1;
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+}
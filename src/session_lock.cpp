@@ -0,0 +1,153 @@
+#include "../include/session_lock.h"
+#include <iostream>
+#include <unistd.h>
+
+static constexpr const char *LOGIND_BUS_NAME = "org.freedesktop.login1";
+static constexpr const char *LOGIND_MANAGER_PATH = "/org/freedesktop/login1";
+static constexpr const char *LOGIND_SESSION_IFACE = "org.freedesktop.login1.Session";
+
+SessionLock::SessionLock()
+    : bus(nullptr), properties_sub_id(0), unlock_sub_id(0), is_locked(false) {}
+
+SessionLock::~SessionLock() {
+    if (bus) {
+        if (properties_sub_id > 0) g_dbus_connection_signal_unsubscribe(bus, properties_sub_id);
+        if (unlock_sub_id > 0) g_dbus_connection_signal_unsubscribe(bus, unlock_sub_id);
+        g_object_unref(bus);
+    }
+}
+
+// The session of this process, or the user's graphical session when
+// vidwall runs outside of one (e.g. as a systemd user service)
+bool SessionLock::find_session() {
+    GError *error = nullptr;
+    GVariant *reply = g_dbus_connection_call_sync(bus, LOGIND_BUS_NAME, LOGIND_MANAGER_PATH,
+        "org.freedesktop.login1.Manager", "GetSessionByPID",
+        g_variant_new("(u)", (guint32)getpid()), G_VARIANT_TYPE("(o)"),
+        G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+    if (reply) {
+        const gchar *path = nullptr;
+        g_variant_get(reply, "(&o)", &path);
+        session_path = path;
+        g_variant_unref(reply);
+        return true;
+    }
+    g_clear_error(&error);
+
+    reply = g_dbus_connection_call_sync(bus, LOGIND_BUS_NAME, "/org/freedesktop/login1/user/self",
+        "org.freedesktop.DBus.Properties", "Get",
+        g_variant_new("(ss)", "org.freedesktop.login1.User", "Display"), G_VARIANT_TYPE("(v)"),
+        G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+    if (!reply) {
+        g_clear_error(&error);
+        return false;
+    }
+
+    GVariant *display = nullptr;
+    g_variant_get(reply, "(v)", &display);
+    const gchar *id = nullptr;
+    const gchar *path = nullptr;
+    g_variant_get(display, "(&s&o)", &id, &path);
+    if (path && g_strcmp0(path, "/") != 0) {
+        session_path = path;
+    }
+    g_variant_unref(display);
+    g_variant_unref(reply);
+    return !session_path.empty();
+}
+
+bool SessionLock::read_locked_hint(bool& locked) {
+    GError *error = nullptr;
+    GVariant *reply = g_dbus_connection_call_sync(bus, LOGIND_BUS_NAME, session_path.c_str(),
+        "org.freedesktop.DBus.Properties", "Get",
+        g_variant_new("(ss)", LOGIND_SESSION_IFACE, "LockedHint"), G_VARIANT_TYPE("(v)"),
+        G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+    if (!reply) {
+        g_clear_error(&error);
+        return false;
+    }
+
+    GVariant *value = nullptr;
+    g_variant_get(reply, "(v)", &value);
+    locked = g_variant_get_boolean(value);
+    g_variant_unref(value);
+    g_variant_unref(reply);
+    return true;
+}
+
+void SessionLock::set_locked(bool locked) {
+    if (locked == is_locked) return;
+    is_locked = locked;
+
+    std::cout << "Session " << (locked ? "locked" : "unlocked") << std::endl;
+    if (on_lock_change) on_lock_change(locked);
+}
+
+void SessionLock::on_properties_changed(GDBusConnection *connection, const gchar *sender,
+                                        const gchar *object_path, const gchar *interface_name,
+                                        const gchar *signal_name, GVariant *parameters,
+                                        gpointer user_data) {
+    (void)connection; (void)sender; (void)object_path; (void)interface_name; (void)signal_name;
+    auto *self = static_cast<SessionLock*>(user_data);
+
+    const gchar *iface = nullptr;
+    GVariant *changed = nullptr;
+    const gchar **invalidated = nullptr;
+    g_variant_get(parameters, "(&s@a{sv}^a&s)", &iface, &changed, &invalidated);
+
+    if (g_strcmp0(iface, LOGIND_SESSION_IFACE) == 0) {
+        gboolean locked = FALSE;
+        if (g_variant_lookup(changed, "LockedHint", "b", &locked)) {
+            self->set_locked(locked);
+        } else if (invalidated && g_strv_contains(invalidated, "LockedHint")) {
+            bool current = false;
+            if (self->read_locked_hint(current)) self->set_locked(current);
+        }
+    }
+
+    g_variant_unref(changed);
+    g_free(invalidated);
+}
+
+// Unlock requests (loginctl unlock-session) end the lock even when the
+// locker does not clear the hint
+void SessionLock::on_unlock(GDBusConnection *connection, const gchar *sender,
+                            const gchar *object_path, const gchar *interface_name,
+                            const gchar *signal_name, GVariant *parameters,
+                            gpointer user_data) {
+    (void)connection; (void)sender; (void)object_path; (void)interface_name;
+    (void)signal_name; (void)parameters;
+    static_cast<SessionLock*>(user_data)->set_locked(false);
+}
+
+bool SessionLock::start(LockCallback callback) {
+    GError *error = nullptr;
+    bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
+    if (!bus) {
+        std::cerr << "System bus not available: " << (error ? error->message : "unknown error") << std::endl;
+        g_clear_error(&error);
+        return false;
+    }
+
+    if (!find_session()) {
+        std::cerr << "No logind session found" << std::endl;
+        return false;
+    }
+
+    on_lock_change = callback;
+
+    properties_sub_id = g_dbus_connection_signal_subscribe(bus, LOGIND_BUS_NAME,
+        "org.freedesktop.DBus.Properties", "PropertiesChanged", session_path.c_str(),
+        nullptr, G_DBUS_SIGNAL_FLAGS_NONE, on_properties_changed, this, nullptr);
+    unlock_sub_id = g_dbus_connection_signal_subscribe(bus, LOGIND_BUS_NAME,
+        LOGIND_SESSION_IFACE, "Unlock", session_path.c_str(),
+        nullptr, G_DBUS_SIGNAL_FLAGS_NONE, on_unlock, this, nullptr);
+
+    bool locked = false;
+    if (read_locked_hint(locked)) {
+        set_locked(locked);
+    }
+
+    std::cout << "Watching lock state of " << session_path << std::endl;
+    return true;
+}
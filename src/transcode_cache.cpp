@@ -0,0 +1,559 @@
+#include "../include/transcode_cache.h"
+#include "../include/resource_usage.h"
+#include "../include/mpv_config.h"
+#include <gtk/gtk.h>
+#include <epoxy/gl.h>
+#include <epoxy/egl.h>
+#include <mpv/client.h>
+#include <mpv/render_gl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <sys/stat.h>
+
+namespace transcode_cache {
+
+static constexpr const char *INDEX_NAME = "index.tsv";
+static constexpr double MEASURE_SECONDS = 10.0;    // of video decoded per measurement
+static constexpr double MEASURE_TIMEOUT_S = 30.0;
+static constexpr int MEASURE_FBO_SIZE = 64;
+static constexpr double PROBE_SECONDS = 3.0;       // of video encoded per probed codec
+static constexpr double PROBE_MARGIN = 0.9;        // a later codec has to be 10% cheaper
+static constexpr size_t HASH_HEX_LENGTH = 64;      // SHA-256
+static constexpr double PROGRESS_INTERVAL_S = 5.0;
+
+// One line of the index, tab separated
+struct IndexLine {
+    std::string path;
+    int64_t size = 0;
+    int64_t mtime_ns = 0;
+    std::string file;     // name inside cache_dir()
+    DecodeCost source;
+    DecodeCost optimized;
+};
+
+std::string cache_dir() {
+    return std::string(g_get_user_cache_dir()) + "/vidwall";
+}
+
+// The target's part of a cached file's name, which is
+// <hash><target key>-<codec>.mkv
+static std::string target_key(const Target& target) {
+    return "-" + std::to_string(target.width) + "x" + std::to_string(target.height) +
+           (target.fps > 0 ? "-" + std::to_string(target.fps) + "fps" : "") +
+           (target.audio ? "-audio" : "");
+}
+
+static bool for_target(const std::string& name, const std::string& key) {
+    static const std::string extension = ".mkv";
+    return name.size() > HASH_HEX_LENGTH + key.size() + extension.size() &&
+           name.compare(HASH_HEX_LENGTH, key.size() + 1, key + "-") == 0 &&
+           name.compare(name.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+static std::string absolute_path(const std::string& path) {
+    char *canonical = g_canonicalize_filename(path.c_str(), nullptr);
+    std::string result = canonical;
+    g_free(canonical);
+    return result;
+}
+
+static bool file_identity(const std::string& path, int64_t& size, int64_t& mtime_ns) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+static std::vector<IndexLine> read_index() {
+    std::vector<IndexLine> lines;
+    std::ifstream in(cache_dir() + "/" + INDEX_NAME);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (;;) {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab - start));
+            if (tab == std::string::npos) break;
+            start = tab + 1;
+        }
+        if (fields.size() != 8) continue;
+
+        IndexLine entry;
+        entry.path = fields[0];
+        entry.size = std::strtoll(fields[1].c_str(), nullptr, 10);
+        entry.mtime_ns = std::strtoll(fields[2].c_str(), nullptr, 10);
+        entry.file = fields[3];
+        entry.source.cpu_ms_per_frame = std::strtod(fields[4].c_str(), nullptr);
+        entry.source.fps = std::strtod(fields[5].c_str(), nullptr);
+        entry.optimized.cpu_ms_per_frame = std::strtod(fields[6].c_str(), nullptr);
+        entry.optimized.fps = std::strtod(fields[7].c_str(), nullptr);
+        lines.push_back(entry);
+    }
+    return lines;
+}
+
+// Written beside and renamed over, so a crash leaves the old index
+static bool write_index(const std::vector<IndexLine>& lines) {
+    std::string path = cache_dir() + "/" + INDEX_NAME;
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (const auto& entry : lines) {
+            out << entry.path << '\t' << entry.size << '\t' << entry.mtime_ns << '\t' << entry.file << '\t'
+                << entry.source.cpu_ms_per_frame << '\t' << entry.source.fps << '\t'
+                << entry.optimized.cpu_ms_per_frame << '\t' << entry.optimized.fps << '\n';
+        }
+        if (!out) return false;
+    }
+    return g_rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// SHA-256 of the file's contents as hex, empty on read errors
+static std::string content_hash(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return "";
+
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    std::vector<char> buffer(1 << 20);
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        if (in.gcount() > 0) {
+            g_checksum_update(checksum, reinterpret_cast<const guchar*>(buffer.data()), in.gcount());
+        }
+    }
+    std::string hash = in.bad() ? "" : g_checksum_get_string(checksum);
+    g_checksum_free(checksum);
+    return hash;
+}
+
+// Encoders tried, in order of preference: a later one is only chosen if it
+// decodes clearly cheaper than the ones before
+struct Codec {
+    const char *name;               // in the cached file's name
+    const char *encoder;
+    const char *options;            // ovcopts
+    const char *software_options;   // ovcopts when playback decodes in software
+};
+
+static const Codec CODECS[] = {
+    // Without hardware decoding the cheapest stream for libavcodec skips
+    // CABAC and the deblocking filter
+    {"h264", "libx264", "preset=medium,crf=18,profile=high", "preset=medium,crf=18,tune=fastdecode"},
+    {"hevc", "libx265", "preset=medium,crf=20", "preset=medium,crf=20,tune=fastdecode"},
+    {"vp9", "libvpx-vp9", "crf=31,b=0,row-mt=1,cpu-used=2", "crf=31,b=0,row-mt=1,cpu-used=2"},
+    {"av1", "libsvtav1", "preset=8,crf=30", "preset=8,crf=30"},
+};
+
+// How the video is brought to the target size and rate
+struct Fit {
+    int width = 0;
+    int height = 0;
+    bool scale = false;
+    int fps = 0;          // rate the fps filter caps at, 0 keeps the source's
+};
+
+// What a measurement saw besides the cost
+struct VideoInfo {
+    int width = 0;
+    int height = 0;
+    double fps = 0.0;     // container-fps, 0 if unknown
+    std::string hwdec;    // hwdec-current while decoding, "no" for software
+};
+
+// Decoding into the encoder needs the frames in system memory
+static const char *transcode_hwdec(const CliArgs& args) {
+    return std::string(hwdec_mode(args)) == "no" ? "no" : "auto-copy";
+}
+
+static void *get_proc_address(void *ctx, const char *name) {
+    (void)ctx;
+    return (void *)eglGetProcAddress(name);
+}
+
+// Set from mpv's render thread when a frame is ready
+struct RenderWait {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool update = false;
+};
+
+static void on_render_update(void *ctx) {
+    auto *wait = static_cast<RenderWait*>(ctx);
+    std::lock_guard<std::mutex> lock(wait->mutex);
+    wait->update = true;
+    wait->cond.notify_one();
+}
+
+// Decodes the first MEASURE_SECONDS as fast as possible through the render
+// API with the hwdec playback uses, so hardware decoded frames go through
+// the same interop instead of being copied back. Frames are drawn into a
+// small framebuffer, the cost is decoding rather than scaling. info gets
+// the video size and hwdec if not null.
+static DecodeCost measure(const std::string& file, const CliArgs& args, VideoInfo *info) {
+    DecodeCost cost;
+    GError *error = nullptr;
+    GdkGLContext *gl_context = gdk_display_create_gl_context(gdk_display_get_default(), &error);
+    if (gl_context && !gdk_gl_context_realize(gl_context, &error)) {
+        g_clear_object(&gl_context);
+    }
+    if (!gl_context) {
+        std::cerr << "Optimize: no GL context to measure with: " << (error ? error->message : "unknown error")
+                  << std::endl;
+        g_clear_error(&error);
+        return cost;
+    }
+    gdk_gl_context_make_current(gl_context);
+
+    GLuint texture = 0, fbo = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, MEASURE_FBO_SIZE, MEASURE_FBO_SIZE, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    mpv_handle *mpv = mpv_create();
+    mpv_render_context *mpv_gl = nullptr;
+    RenderWait wait;
+    if (mpv) {
+        mpv_set_option_string(mpv, "vo", "libmpv");
+        mpv_set_option_string(mpv, "hwdec", hwdec_mode(args));
+        mpv_set_option_string(mpv, "aid", "no");
+        mpv_set_option_string(mpv, "untimed", "yes");
+        mpv_set_option_string(mpv, "framedrop", "no");
+        mpv_set_option_string(mpv, "loop-file", "no");
+        mpv_set_option_string(mpv, "end", std::to_string(MEASURE_SECONDS).c_str());
+
+        mpv_opengl_init_params gl_init_params{
+            .get_proc_address = get_proc_address,
+            .get_proc_address_ctx = nullptr
+        };
+        mpv_render_param params[]{
+            {MPV_RENDER_PARAM_API_TYPE, const_cast<char*>(MPV_RENDER_API_TYPE_OPENGL)},
+            {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &gl_init_params},
+            {MPV_RENDER_PARAM_INVALID, nullptr}
+        };
+        if (mpv_initialize(mpv) < 0 || mpv_render_context_create(&mpv_gl, mpv, params) < 0) {
+            mpv_gl = nullptr;
+        }
+    }
+
+    auto decode_start = std::chrono::steady_clock::now();
+    int64_t cpu_start = -1;
+    int64_t frames = 0;
+    if (mpv_gl) {
+        mpv_render_context_set_update_callback(mpv_gl, on_render_update, &wait);
+        const char *cmd[] = {"loadfile", file.c_str(), nullptr};
+        mpv_command(mpv, cmd);
+
+        mpv_opengl_fbo mpv_fbo{
+            .fbo = static_cast<int>(fbo),
+            .w = MEASURE_FBO_SIZE,
+            .h = MEASURE_FBO_SIZE,
+            .internal_format = GL_RGBA8
+        };
+        int block = 0;
+        mpv_render_param render_params[]{
+            {MPV_RENDER_PARAM_OPENGL_FBO, &mpv_fbo},
+            {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &block},
+            {MPV_RENDER_PARAM_INVALID, nullptr}
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        bool ended = false;
+        while (!ended &&
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < MEASURE_TIMEOUT_S) {
+            for (mpv_event *event = mpv_wait_event(mpv, 0); event->event_id != MPV_EVENT_NONE;
+                 event = mpv_wait_event(mpv, 0)) {
+                if (event->event_id == MPV_EVENT_END_FILE) ended = true;
+                if (event->event_id == MPV_EVENT_FILE_LOADED) {
+                    int64_t w = 0, h = 0;
+                    mpv_get_property(mpv, "width", MPV_FORMAT_INT64, &w);
+                    mpv_get_property(mpv, "height", MPV_FORMAT_INT64, &h);
+                    if (info) {
+                        info->width = static_cast<int>(w);
+                        info->height = static_cast<int>(h);
+                        mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &info->fps);
+                    }
+                    cpu_start = resource_usage::cpu_time_us();
+                    decode_start = std::chrono::steady_clock::now();
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(wait.mutex);
+                wait.cond.wait_for(lock, std::chrono::milliseconds(10), [&] { return wait.update; });
+                if (!wait.update) continue;
+                wait.update = false;
+            }
+            if (!(mpv_render_context_update(mpv_gl) & MPV_RENDER_UPDATE_FRAME)) continue;
+            mpv_render_context_render(mpv_gl, render_params);
+            if (cpu_start < 0) continue;
+            // Known once the first frame came out of the decoder
+            if (frames++ == 0 && info) {
+                char *current = mpv_get_property_string(mpv, "hwdec-current");
+                info->hwdec = current ? current : "no";
+                mpv_free(current);
+            }
+        }
+        glFinish();
+    } else {
+        std::cerr << "Optimize: cannot set up mpv to measure with" << std::endl;
+    }
+    int64_t cpu_us = resource_usage::cpu_time_us() - cpu_start;
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - decode_start).count();
+
+    // The render context goes first, with the GL context current
+    if (mpv_gl) mpv_render_context_free(mpv_gl);
+    if (mpv) mpv_terminate_destroy(mpv);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    gdk_gl_context_clear_current();
+    g_object_unref(gl_context);
+
+    if (cpu_start >= 0 && frames > 0 && wall_s > 0.0) {
+        cost.cpu_ms_per_frame = cpu_us / 1000.0 / frames;
+        cost.fps = frames / wall_s;
+    }
+    return cost;
+}
+
+// Encodes with mpv's encoding mode: the same demuxer, decoder and filters
+// as playback, the output going to libavcodec instead of a VO. end_s > 0
+// stops after that many seconds of the source.
+static bool transcode(const std::string& source, const std::string& output, const Target& target,
+                      const CliArgs& args, const Codec& codec, const Fit& fit, double end_s) {
+    mpv_handle *mpv = mpv_create();
+    if (!mpv) return false;
+
+    bool software_decode = std::string(hwdec_mode(args)) == "no";
+    mpv_set_option_string(mpv, "o", output.c_str());
+    mpv_set_option_string(mpv, "of", "matroska");
+    mpv_set_option_string(mpv, "ovc", codec.encoder);
+    mpv_set_option_string(mpv, "ovcopts", software_decode ? codec.software_options : codec.options);
+    mpv_set_option_string(mpv, "hwdec", transcode_hwdec(args));
+    mpv_set_option_string(mpv, "loop-file", "no");
+    if (end_s > 0.0) {
+        mpv_set_option_string(mpv, "end", std::to_string(end_s).c_str());
+    }
+    if (target.audio) {
+        mpv_set_option_string(mpv, "oac", "aac");
+    } else {
+        mpv_set_option_string(mpv, "aid", "no");
+    }
+
+    std::string filters;
+    if (fit.scale) {
+        filters = "scale=w=" + std::to_string(fit.width) + ":h=" + std::to_string(fit.height) + ",";
+    }
+    if (fit.fps > 0) {
+        filters += "fps=fps=" + std::to_string(fit.fps) + ",";
+    }
+    filters += "format=yuv420p";
+    mpv_set_option_string(mpv, "vf", filters.c_str());
+
+    if (mpv_initialize(mpv) < 0) {
+        mpv_terminate_destroy(mpv);
+        return false;
+    }
+
+    const char *cmd[] = {"loadfile", source.c_str(), nullptr};
+    mpv_command(mpv, cmd);
+
+    bool ok = false;
+    auto last_progress = std::chrono::steady_clock::now();
+    for (;;) {
+        mpv_event *event = mpv_wait_event(mpv, 1.0);
+        if (event->event_id == MPV_EVENT_END_FILE) {
+            ok = static_cast<mpv_event_end_file *>(event->data)->reason == MPV_END_FILE_REASON_EOF;
+            break;
+        }
+        if (event->event_id == MPV_EVENT_SHUTDOWN) break;
+
+        auto now = std::chrono::steady_clock::now();
+        if (end_s <= 0.0 && std::chrono::duration<double>(now - last_progress).count() >= PROGRESS_INTERVAL_S) {
+            last_progress = now;
+            double percent = 0.0;
+            if (mpv_get_property(mpv, "percent-pos", MPV_FORMAT_DOUBLE, &percent) >= 0) {
+                std::cout << "Optimize: " << static_cast<int>(percent) << "%" << std::endl;
+            }
+        }
+    }
+
+    // Flushes the encoder and finishes the file
+    mpv_terminate_destroy(mpv);
+    return ok;
+}
+
+// Encodes the first PROBE_SECONDS with every codec and measures how each
+// decodes with playback's hwdec: a codec the GPU decodes costs little CPU,
+// one it cannot falls back to software. Missing encoders are skipped.
+static const Codec& probe_codec(const std::string& source, const std::string& prefix, const Target& target,
+                                const CliArgs& args, const Fit& fit) {
+    Target probe_target = target;
+    probe_target.audio = false;
+
+    const Codec *best = &CODECS[0];
+    double best_ms = -1.0;
+    for (const Codec& codec : CODECS) {
+        std::string probe = prefix + "-probe-" + codec.name + ".mkv";
+        bool encoded = transcode(source, probe, probe_target, args, codec, fit, PROBE_SECONDS);
+        VideoInfo info;
+        DecodeCost cost;
+        if (encoded) cost = measure(probe, args, &info);
+        g_remove(probe.c_str());
+
+        if (!encoded) {
+            std::cout << "Optimize: " << codec.name << " skipped, " << codec.encoder << " unavailable" << std::endl;
+            continue;
+        }
+        std::cout << "Optimize: " << codec.name << " decodes at " << cost.cpu_ms_per_frame << " ms/frame (hwdec "
+                  << (info.hwdec.empty() ? "unknown" : info.hwdec) << ")" << std::endl;
+        if (cost.cpu_ms_per_frame < 0.0) continue;
+        if (best_ms < 0.0 || cost.cpu_ms_per_frame < best_ms * PROBE_MARGIN) {
+            best = &codec;
+            best_ms = cost.cpu_ms_per_frame;
+        }
+    }
+    return *best;
+}
+
+Entry lookup(const std::string& path, const Target& target) {
+    Entry entry;
+    std::string absolute = absolute_path(path);
+    int64_t size = 0, mtime_ns = 0;
+    if (!file_identity(absolute, size, mtime_ns)) return entry;
+
+    std::string key = target_key(target);
+    for (const auto& line : read_index()) {
+        if (line.path != absolute || line.size != size || line.mtime_ns != mtime_ns || !for_target(line.file, key)) {
+            continue;
+        }
+        std::string file = cache_dir() + "/" + line.file;
+        if (!g_file_test(file.c_str(), G_FILE_TEST_IS_REGULAR)) continue;
+
+        entry.file = file;
+        entry.source = line.source;
+        entry.optimized = line.optimized;
+        break;
+    }
+    return entry;
+}
+
+Entry create(const std::string& path, const Target& target, const CliArgs& args) {
+    Entry entry;
+    std::string dir = cache_dir();
+    if (g_mkdir_with_parents(dir.c_str(), 0700) != 0) {
+        std::cerr << "Optimize: cannot create " << dir << std::endl;
+        return entry;
+    }
+
+    // The index is line and tab separated
+    std::string absolute = absolute_path(path);
+    if (absolute.find_first_of("\t\n") != std::string::npos) {
+        std::cerr << "Optimize: path contains tabs or newlines, not cached" << std::endl;
+        return entry;
+    }
+    int64_t size = 0, mtime_ns = 0;
+    if (!file_identity(absolute, size, mtime_ns)) {
+        std::cerr << "Optimize: cannot read " << absolute << std::endl;
+        return entry;
+    }
+
+    std::cout << "Optimize: hashing " << absolute << std::endl;
+    std::string hash = content_hash(absolute);
+    if (hash.empty()) {
+        std::cerr << "Optimize: cannot read " << absolute << std::endl;
+        return entry;
+    }
+    VideoInfo source_info;
+    entry.source = measure(absolute, args, &source_info);
+    if (source_info.width <= 0 || source_info.height <= 0) {
+        std::cerr << "Optimize: no video in " << absolute << std::endl;
+        return entry;
+    }
+    int width = source_info.width, height = source_info.height;
+    std::cout << "Optimize: source decodes at " << entry.source.cpu_ms_per_frame << " ms/frame (hwdec "
+              << (source_info.hwdec.empty() ? "unknown" : source_info.hwdec) << ")" << std::endl;
+
+    // The fps filter would duplicate the frames of a slower source into the file
+    Fit fit{width, height, width > target.width || height > target.height,
+            source_info.fps > target.fps ? target.fps : 0};
+    if (fit.scale) {
+        double factor = std::min(static_cast<double>(target.width) / width,
+                                 static_cast<double>(target.height) / height);
+        // 4:2:0 needs even dimensions
+        fit.width = std::max(2, static_cast<int>(width * factor) & ~1);
+        fit.height = std::max(2, static_cast<int>(height * factor) & ~1);
+    }
+
+    // The same content may have been transcoded under another path
+    std::string key = target_key(target);
+    std::string name;
+    for (const Codec& codec : CODECS) {
+        std::string candidate = hash + key + "-" + codec.name + ".mkv";
+        if (g_file_test((dir + "/" + candidate).c_str(), G_FILE_TEST_IS_REGULAR)) {
+            name = candidate;
+            break;
+        }
+    }
+
+    if (name.empty()) {
+        const Codec& codec = probe_codec(absolute, dir + "/" + hash, target, args, fit);
+        name = hash + key + "-" + codec.name + ".mkv";
+        std::string file = dir + "/" + name;
+        std::cout << "Optimize: transcoding " << width << "x" << height << " to " << fit.width << "x"
+                  << fit.height << " " << codec.name << " into " << file << std::endl;
+
+        std::string part = file + ".part";
+        if (!transcode(absolute, part, target, args, codec, fit, 0.0)) {
+            std::cerr << "Optimize: transcoding failed, playing the original" << std::endl;
+            g_remove(part.c_str());
+            return entry;
+        }
+        if (g_rename(part.c_str(), file.c_str()) != 0) {
+            std::cerr << "Optimize: cannot move the result into place" << std::endl;
+            g_remove(part.c_str());
+            return entry;
+        }
+    }
+    std::string file = dir + "/" + name;
+
+    entry.optimized = measure(file, args, nullptr);
+    entry.file = file;
+
+    // One line per path and target, replacing one for an older version of the file
+    std::vector<IndexLine> lines = read_index();
+    lines.erase(std::remove_if(lines.begin(), lines.end(), [&](const IndexLine& line) {
+        return line.path == absolute && for_target(line.file, key);
+    }), lines.end());
+    lines.push_back({absolute, size, mtime_ns, name, entry.source, entry.optimized});
+    if (!write_index(lines)) {
+        std::cerr << "Optimize: index not written, the copy will not be found next time" << std::endl;
+    }
+
+    std::cout << "Optimize: decode CPU " << entry.source.cpu_ms_per_frame << " -> "
+              << entry.optimized.cpu_ms_per_frame << " ms/frame, " << entry.source.fps << " -> "
+              << entry.optimized.fps << " fps flat out" << std::endl;
+    return entry;
+}
+
+bool worthwhile(const Entry& entry) {
+    if (entry.source.cpu_ms_per_frame < 0.0 || entry.optimized.cpu_ms_per_frame < 0.0) return true;
+    return entry.optimized.cpu_ms_per_frame < entry.source.cpu_ms_per_frame;
+}
+
+}
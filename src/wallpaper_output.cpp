@@ -0,0 +1,1516 @@
+#include "../include/wallpaper_output.h"
+#include "../include/resource_usage.h"
+#include "../include/mpv_config.h"
+#include "../include/offscreen_decoder.h"
+#include "../include/wayland_backend.h"
+#include "../include/memory_source.h"
+#include <gtk4-layer-shell.h>
+#include <glib-unix.h>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <epoxy/gl.h>
+#include <epoxy/egl.h>
+
+static bool can_blit_framebuffers() {
+    return epoxy_gl_version() >= 30 || epoxy_has_gl_extension("GL_ARB_framebuffer_object");
+}
+
+// Frames mpv dropped in the decoder or at output so far
+static int64_t dropped_frames(mpv_handle *mpv) {
+    int64_t decoder = 0, output = 0;
+    mpv_get_property(mpv, "decoder-frame-drop-count", MPV_FORMAT_INT64, &decoder);
+    mpv_get_property(mpv, "frame-drop-count", MPV_FORMAT_INT64, &output);
+    return decoder + output;
+}
+
+WallpaperOutput::WallpaperOutput(GtkApplication *app, GdkMonitor *monitor, const CliArgs& args,
+                                 Visibility initial, OffscreenDecoder *shared,
+                                 WaylandConnection *wayland)
+    : app(app), monitor(monitor), args(args), window(nullptr), gl_area(nullptr),
+      mpv(nullptr), mpv_gl(nullptr), offscreen(shared), wayland(wayland), pending_resize_id(0),
+      is_paused(visibility_paused(initial)), is_reduced(initial == Visibility::Partial),
+      applied(initial), target(initial) {
+    g_object_ref(monitor);
+
+    const char *connector = gdk_monitor_get_connector(monitor);
+    name = connector ? connector : "unknown";
+}
+
+WallpaperOutput::~WallpaperOutput() {
+    if (offscreen) offscreen->detach(this);
+
+    if (pending_resize_id > 0) g_source_remove(pending_resize_id);
+    if (transition_timer_id > 0) g_source_remove(transition_timer_id);
+    if (prewarm_timer_id > 0) g_source_remove(prewarm_timer_id);
+    if (deep_pause_timer_id > 0) g_source_remove(deep_pause_timer_id);
+    if (deep_pause_report_id > 0) g_source_remove(deep_pause_report_id);
+    stop_cache_tick();
+    pending_resize_id = 0;
+    transition_timer_id = 0;
+    prewarm_timer_id = 0;
+    deep_pause_timer_id = 0;
+    deep_pause_report_id = 0;
+
+    // The render context goes before mpv; unrealizing the GL area frees it there
+    if (direct) {
+        if (direct->software() || direct->make_current()) {
+            free_snapshot();
+            free_scaled_fbo();
+            drop_frame_cache();
+            gpu_timer.release();
+            if (mpv_gl) {
+                mpv_render_context_free(mpv_gl);
+                mpv_gl = nullptr;
+            }
+        }
+        direct.reset();
+    }
+    if (window) {
+        gtk_window_destroy(window);
+        window = nullptr;
+    }
+
+    if (wakeup_watch_id > 0) {
+        g_source_remove(wakeup_watch_id);
+        wakeup_watch_id = 0;
+    }
+
+    if (mpv) {
+        mpv_set_wakeup_callback(mpv, nullptr, nullptr);
+        mpv_terminate_destroy(mpv);
+        mpv = nullptr;
+    }
+
+    if (wakeup_fd >= 0) {
+        close(wakeup_fd);
+        wakeup_fd = -1;
+    }
+
+    // Drop render requests queued by mpv before the render context was freed
+    while (g_idle_remove_by_data(this)) {}
+
+    g_object_unref(monitor);
+}
+
+void *WallpaperOutput::get_proc_address(void *ctx, const char *name) {
+    (void)ctx;
+    return (void *)eglGetProcAddress(name);
+}
+
+// Called from any mpv thread when its event queue becomes non-empty; must
+// not call into mpv, so it only signals the eventfd the main loop watches
+void WallpaperOutput::on_mpv_wakeup(void *ctx) {
+    auto *self = static_cast<WallpaperOutput*>(ctx);
+    uint64_t one = 1;
+    ssize_t n = write(self->wakeup_fd, &one, sizeof(one));
+    (void)n;   // EAGAIN means a wakeup is already pending
+}
+
+gboolean WallpaperOutput::on_mpv_wakeup_ready(gint fd, GIOCondition condition, gpointer user_data) {
+    (void)condition;
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+
+    uint64_t count;
+    ssize_t n = read(fd, &count, sizeof(count));
+    (void)n;
+
+    self->handle_mpv_events();
+    return G_SOURCE_CONTINUE;
+}
+
+// Called from mpv's threads when the render context has something new.
+// Several calls before the main loop gets to it collapse into one idle.
+void WallpaperOutput::on_mpv_render_update(void *ctx) {
+    auto *self = static_cast<WallpaperOutput*>(ctx);
+    if (self->is_paused.load(std::memory_order_relaxed)) return;
+    if (self->update_queued.exchange(true)) return;
+    g_idle_add_full(G_PRIORITY_HIGH_IDLE, on_render_update_idle, self, nullptr);
+}
+
+// Only a new video frame requests a paint. The paint itself happens on the
+// next frame clock cycle (Wayland frame callback), so renders follow the
+// content rate capped at the display rate, and nothing is drawn while the
+// picture does not change.
+gboolean WallpaperOutput::on_render_update_idle(gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    self->update_queued = false;
+
+    if (!self->mpv_gl || self->is_paused.load(std::memory_order_relaxed)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    uint64_t flags = mpv_render_context_update(self->mpv_gl);
+    if (!(flags & MPV_RENDER_UPDATE_FRAME)) {
+        return G_SOURCE_REMOVE;
+    }
+    self->pass_frames++;
+    self->reload_pending = false;
+    if (self->cache_playing) return G_SOURCE_REMOVE;   // the pause caught up with a queued frame
+    self->queue_frame();
+    return G_SOURCE_REMOVE;
+}
+
+// The offscreen decoder rendered a new frame
+void WallpaperOutput::offscreen_frame_ready() {
+    if (is_paused.load(std::memory_order_relaxed)) return;   // prewarming
+    reload_pending = false;
+    queue_frame();
+}
+
+void WallpaperOutput::queue_frame() {
+    // Skip frames that come sooner than the --fps or reduced cadence
+    int64_t min_interval = min_frame_interval_us();
+    if (min_interval > 0) {
+        auto since_last = std::chrono::steady_clock::now() - last_frame_render;
+        if (std::chrono::duration_cast<std::chrono::microseconds>(since_last).count() < min_interval) {
+            return;
+        }
+    }
+
+    request_render();
+}
+
+void WallpaperOutput::request_render() {
+    if (direct) {
+        direct->queue_render();
+    } else {
+        gtk_gl_area_queue_render(GTK_GL_AREA(gl_area));
+    }
+}
+
+bool WallpaperOutput::software_rendering() const {
+    return direct && direct->software();
+}
+
+bool WallpaperOutput::make_current() {
+    if (direct) return direct->make_current();
+    gtk_gl_area_make_current(GTK_GL_AREA(gl_area));
+    return gtk_gl_area_get_error(GTK_GL_AREA(gl_area)) == nullptr;
+}
+
+// Drawable size: buffer pixels for a direct surface, the widget size for
+// the GL area (as mpv has always been given)
+void WallpaperOutput::surface_size(int& width, int& height) const {
+    if (direct) {
+        width = direct->get_buffer_width();
+        height = direct->get_buffer_height();
+    } else {
+        width = gtk_widget_get_width(gl_area);
+        height = gtk_widget_get_height(gl_area);
+    }
+}
+
+// The frame drawn in this cycle has been handed to the compositor
+void WallpaperOutput::on_after_paint(GdkFrameClock *clock, gpointer user_data) {
+    (void)clock;
+    static_cast<WallpaperOutput*>(user_data)->on_presented();
+}
+
+void WallpaperOutput::on_presented() {
+    if (!swap_pending) return;
+
+    swap_pending = false;
+    present_count++;
+    if (mpv_gl) mpv_render_context_report_swap(mpv_gl);
+}
+
+uint64_t WallpaperOutput::take_render_count() {
+    uint64_t current = render_count.load(std::memory_order_relaxed);
+    uint64_t prev = render_count_snapshot.exchange(current, std::memory_order_relaxed);
+    return current - prev;
+}
+
+uint64_t WallpaperOutput::take_present_count() {
+    uint64_t count = present_count - present_count_snapshot;
+    present_count_snapshot = present_count;
+    return count;
+}
+
+WallpaperOutput::TransitionStats WallpaperOutput::take_transition_stats() {
+    TransitionStats stats = transition_stats;
+    stats.avg_reveal_ms = stats.reveals > 0 ? reveal_total_us / 1000.0 / stats.reveals : 0.0;
+    transition_stats = TransitionStats{};
+    reveal_total_us = 0;
+    return stats;
+}
+
+void WallpaperOutput::take_render_time(double& avg_ms, double& max_ms) {
+    avg_ms = render_time_frames > 0 ? render_time_total_us / 1000.0 / render_time_frames : 0.0;
+    max_ms = render_time_max_us / 1000.0;
+    render_time_total_us = 0;
+    render_time_max_us = 0;
+    render_time_frames = 0;
+}
+
+void WallpaperOutput::monitor_pixel_size(int& width, int& height) const {
+    GdkRectangle geom;
+    gdk_monitor_get_geometry(monitor, &geom);
+#if GTK_CHECK_VERSION(4, 14, 0)
+    double scale = gdk_monitor_get_scale(monitor);
+#else
+    double scale = gdk_monitor_get_scale_factor(monitor);
+#endif
+    width = static_cast<int>(geom.width * scale + 0.5);
+    height = static_cast<int>(geom.height * scale + 0.5);
+}
+
+WallpaperOutput::LoopStats WallpaperOutput::take_loop_stats() {
+    LoopStats stats;
+    stats.loops = loops;
+    stats.avg_seam_ms = loops > 0 ? seam_total_us / 1000.0 / loops : 0.0;
+    stats.max_seam_ms = seam_max_us / 1000.0;
+    loops = 0;
+    seam_total_us = 0;
+    seam_max_us = 0;
+    return stats;
+}
+
+bool WallpaperOutput::start() {
+    if (wayland) {
+        direct = std::make_unique<WaylandSurface>(*wayland, name, args.backend == "software",
+            [this](const WaylandSurface::Target& target) {
+                if (!target.pixels) return draw(target.width, target.height);
+                // Software rendering only fills the video's part, bars stay as they are
+                auto *origin = static_cast<uint8_t*>(target.pixels) +
+                               target.content.y * target.stride + target.content.x * 4;
+                return draw(target.content.width, target.content.height, origin, target.stride);
+            },
+            [this]() { on_presented(); });
+        direct->set_opaque(args.opaque);
+        if (!direct->create()) {
+            std::cerr << "[" << name << "] Direct layer surface failed, using GTK" << std::endl;
+            direct.reset();
+        }
+    }
+    if (!direct) setup_window();
+
+    // Without a shared decoder, --render-thread gives this output an offscreen
+    // one; offscreen frames are blitted in a GL area
+    if (args.render_thread && !offscreen && !direct) {
+        own_offscreen = std::make_unique<OffscreenDecoder>(args, name);
+        if (own_offscreen->start(gdk_monitor_get_display(monitor), true)) {
+            offscreen = own_offscreen.get();
+        } else {
+            std::cerr << "[" << name << "] No render thread, rendering on the main thread" << std::endl;
+            own_offscreen.reset();
+        }
+    }
+
+    if (offscreen) {
+        offscreen->attach(this);
+        return true;
+    }
+
+    setup_mpv();
+
+    if (!mpv) {
+        std::cerr << "[" << name << "] mpv setup failed" << std::endl;
+        return false;
+    }
+
+    setup_rendering();
+
+    if (!mpv_gl) {
+        std::cerr << "[" << name << "] Rendering setup failed" << std::endl;
+        return false;
+    }
+
+    setup_frame_cache();
+    load_video();
+    return true;
+}
+
+void WallpaperOutput::handle_mpv_events() {
+    while (mpv) {
+        mpv_event *event = mpv_wait_event(mpv, 0);
+        if (event->event_id == MPV_EVENT_NONE) break;
+
+        if (event->event_id == MPV_EVENT_END_FILE) {
+            // Drain the whole queue, the wakeup fires only for new events
+            if (is_paused.load(std::memory_order_relaxed)) continue;
+
+            mpv_event_end_file *ef = (mpv_event_end_file *)event->data;
+            if (args.skip_static && ef->reason == MPV_END_FILE_REASON_EOF) {
+                finish_pass();
+            }
+            if (ef->reason == MPV_END_FILE_REASON_ERROR) {
+                std::cerr << "[" << name << "] Error, reloading..." << std::endl;
+                load_video();
+            }
+        } else if (event->event_id == MPV_EVENT_PLAYBACK_RESTART) {
+            // Start of playback and every loop-file wrap
+            if (args.skip_static) finish_pass();
+            if (frame_cache) on_loop_start();
+
+            // Reloads restart too; the first frame after this shows the seam
+            if (last_frame_render != std::chrono::steady_clock::time_point{} && !reload_pending &&
+                !is_paused.load(std::memory_order_relaxed)) {
+                loop_restart = true;
+            }
+
+            // Loops restart from "start" too, put it back once the reload used it
+            if (restore_start) {
+                restore_start = false;
+                mpv_set_property_string(mpv, "start", saved_start.c_str());
+            }
+        } else if (event->event_id == MPV_EVENT_VIDEO_RECONFIG) {
+            // hwdec-current is known from here; once, the filter added triggers another
+            if (!downscale_checked) {
+                downscale_checked = true;
+                int target_width = 0, target_height = 0, fit_width = 0, fit_height = 0;
+                monitor_pixel_size(target_width, target_height);
+                downscale = apply_downscale(mpv, args, target_width, target_height, !software_rendering(),
+                                            fit_width, fit_height);
+                std::cout << "[" << name << "] Downscale for " << target_width << "x" << target_height
+                          << ": " << downscale_path_name(downscale) << " (" << fit_width << "x" << fit_height
+                          << ")" << std::endl;
+            }
+        } else if (event->event_id == MPV_EVENT_FILE_LOADED) {
+            std::cout << "[" << name << "] Video loaded" << std::endl;
+
+            int64_t width = 0, height = 0;
+            mpv_get_property(mpv, "width", MPV_FORMAT_INT64, &width);
+            mpv_get_property(mpv, "height", MPV_FORMAT_INT64, &height);
+
+            if (width > 0 && height > 0) {
+                set_video_size(width, height);
+            }
+
+            if (args.fps > 0 && !decoder_skip_checked) {
+                decoder_skip_checked = true;
+                double source_fps = 0.0;
+                if (!apply_fps_cap(mpv, args.fps, source_fps)) {
+                    std::cout << "[" << name << "] Source " << source_fps << " fps, not above --fps "
+                              << args.fps << ", left uncapped" << std::endl;
+                }
+                decoder_skip = enable_decoder_skip(mpv, args.fps, source_fps);
+                if (decoder_skip) {
+                    std::cout << "[" << name << "] Source " << source_fps
+                              << " fps, decoder skips non-reference frames" << std::endl;
+                }
+            }
+        }
+    }
+}
+
+// Reports the share of frames mpdecimate dropped during the loop pass that
+// just ended, then starts counting the next one. Frames that reach the
+// renderer are compared against clip duration x input rate; passes that
+// were paused midway are not reported.
+void WallpaperOutput::finish_pass() {
+    if (pass_started && !pass_interrupted) {
+        double duration = 0.0, source_fps = 0.0;
+        mpv_get_property(mpv, "duration", MPV_FORMAT_DOUBLE, &duration);
+        mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &source_fps);
+
+        double input_fps = args.fps > 0 ? std::min<double>(args.fps, source_fps) : source_fps;
+        double expected = duration * input_fps;
+        if (expected >= 1.0) {
+            last_skip_fraction = std::clamp(1.0 - pass_frames / expected, 0.0, 1.0);
+            std::cout << "[" << name << "] Loop pass: " << static_cast<int>(last_skip_fraction * 100.0 + 0.5)
+                      << "% of " << static_cast<uint64_t>(expected + 0.5)
+                      << " frames skipped as static" << std::endl;
+        }
+    }
+
+    pass_started = true;
+    pass_interrupted = false;
+    pass_frames = 0;
+}
+
+void WallpaperOutput::get_decode_rates(double& source_fps, double& filtered_fps) {
+    if (offscreen) {
+        offscreen->get_decode_rates(source_fps, filtered_fps);
+        return;
+    }
+
+    source_fps = 0.0;
+    filtered_fps = 0.0;
+    if (!mpv || is_paused) return;
+
+    mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &source_fps);
+    mpv_get_property(mpv, "estimated-vf-fps", MPV_FORMAT_DOUBLE, &filtered_fps);
+}
+
+bool WallpaperOutput::decoder_skipping() const {
+    return offscreen ? offscreen->decoder_skipping() : decoder_skip;
+}
+
+void WallpaperOutput::set_video_size(int64_t video_width, int64_t video_height) {
+    if (video_width == last_video_width && video_height == last_video_height) return;
+    last_video_width = video_width;
+    last_video_height = video_height;
+    if (direct) direct->set_video_size(video_width, video_height);
+    adjust_window_for_aspect_ratio(video_width, video_height);
+}
+
+void WallpaperOutput::adjust_window_for_aspect_ratio(int64_t video_width, int64_t video_height) {
+    double aspect_ratio = (double)video_width / (double)video_height;
+
+    std::cout << "[" << name << "] Video: " << video_width << "x" << video_height
+              << " (aspect: " << aspect_ratio << ")" << std::endl;
+
+    GdkRectangle geom;
+    gdk_monitor_get_geometry(monitor, &geom);
+
+    if (pending_resize_id > 0) {
+        g_source_remove(pending_resize_id);
+        pending_resize_id = 0;
+    }
+
+    // Vertical video (9:16 or similar) - resize to maintain aspect ratio
+    if (aspect_ratio < 1.0) {
+        int window_width = (int)(geom.height * aspect_ratio);
+
+        struct ResizeData {
+            WallpaperOutput *self;
+            int width;
+            int height;
+        };
+
+        auto *data = new ResizeData{this, window_width, geom.height};
+
+        pending_resize_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, [](gpointer user_data) -> gboolean {
+            auto *resize_data = static_cast<ResizeData*>(user_data);
+            resize_data->self->pending_resize_id = 0;
+
+            if (resize_data->self->direct) {
+                resize_data->self->direct->set_size(resize_data->width, 0);
+                return G_SOURCE_REMOVE;
+            }
+
+            gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_LEFT, FALSE);
+            gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_RIGHT, FALSE);
+            gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_TOP, TRUE);
+            gtk_layer_set_anchor(resize_data->self->window, GTK_LAYER_SHELL_EDGE_BOTTOM, TRUE);
+
+            gtk_widget_set_size_request(GTK_WIDGET(resize_data->self->window),
+                                       resize_data->width,
+                                       resize_data->height);
+
+            return G_SOURCE_REMOVE;
+        }, data, [](gpointer user_data) {
+            delete static_cast<ResizeData*>(user_data);
+        });
+
+        std::cout << "[" << name << "] Vertical video: will resize to " << window_width << "x" << geom.height << "px" << std::endl;
+    } else {
+        std::cout << "[" << name << "] Horizontal video: keeping fullscreen" << std::endl;
+    }
+}
+
+void WallpaperOutput::pause_video() {
+    if ((!mpv && !offscreen) || is_paused) return;
+
+    is_paused = true;
+    reveal_pending = false;
+    pass_interrupted = true;
+    loop_restart = false;
+    stop_cache_tick();
+    if (cache_recording) abandon_cache_recording("paused");
+
+    if (offscreen) {
+        offscreen->set_active(this, false);
+        if (own_offscreen) schedule_deep_pause();
+    } else {
+        // Freeze mpv pipeline in-place (decoder/render threads go idle immediately).
+        // The update callback stays registered and ignores frames while paused.
+        mpv_set_property_string(mpv, "pause", "yes");
+        schedule_deep_pause();
+    }
+
+    std::cout << "[" << name << "] Video paused" << std::endl;
+}
+
+void WallpaperOutput::resume_video() {
+    if ((!mpv && !offscreen && !deep_paused) || !is_paused) return;
+
+    // A prewarmed decoder is already running
+    bool warm = prewarming;
+    if (prewarm_timer_id > 0) {
+        g_source_remove(prewarm_timer_id);
+        prewarm_timer_id = 0;
+    }
+    prewarming = false;
+
+    if (deep_pause_timer_id > 0) {
+        g_source_remove(deep_pause_timer_id);
+        deep_pause_timer_id = 0;
+    }
+    leave_deep_pause();
+    if (offscreen) {
+        offscreen->set_active(this, true);
+    } else if (mpv && !cache_playing) {
+        mpv_set_property_string(mpv, "pause", "no");
+    }
+    is_paused = false;
+
+    // Carry on from the frame shown when pausing
+    if (cache_playing) {
+        cache_epoch = std::chrono::steady_clock::now() -
+                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(cache_index * cache_frame_s));
+        start_cache_tick();
+    }
+
+    // Show the current frame right away, updates drive rendering from here
+    if (mpv_gl || offscreen) {
+        request_render();
+    }
+    std::cout << "[" << name << "] Video resumed" << (warm ? " (prewarmed)" : "") << std::endl;
+}
+
+void WallpaperOutput::prewarm() {
+    if ((!mpv && !offscreen && !deep_paused) || !is_paused || prewarming || applied == Visibility::Off) return;
+
+    // Decoding fills mpv's frame queue and then waits for the renderer, so
+    // the first frame is ready when the output is revealed
+    prewarming = true;
+    note_reveal();
+    transition_stats.prewarms++;
+    if (deep_pause_timer_id > 0) {
+        g_source_remove(deep_pause_timer_id);
+        deep_pause_timer_id = 0;
+    }
+    leave_deep_pause();
+    if (offscreen) {
+        offscreen->set_active(this, true);
+    } else if (mpv && !cache_playing) {
+        // Cached frames need no warming up
+        mpv_set_property_string(mpv, "pause", "no");
+    }
+
+    prewarm_timer_id = g_timeout_add(args.resume_delay_ms + PREWARM_TIMEOUT_MS, on_prewarm_timeout, this);
+}
+
+// No reveal followed the prewarm (the workspace was left again, or
+// something else still covers the output)
+gboolean WallpaperOutput::on_prewarm_timeout(gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    self->prewarm_timer_id = 0;
+    self->end_prewarm();
+    return G_SOURCE_REMOVE;
+}
+
+void WallpaperOutput::end_prewarm() {
+    if (!prewarming) return;
+
+    if (prewarm_timer_id > 0) {
+        g_source_remove(prewarm_timer_id);
+        prewarm_timer_id = 0;
+    }
+    prewarming = false;
+    reveal_pending = false;
+    transition_stats.wasted_prewarms++;
+
+    if (is_paused && offscreen) {
+        offscreen->set_active(this, false);
+        if (own_offscreen) schedule_deep_pause();
+    } else if (is_paused && mpv) {
+        mpv_set_property_string(mpv, "pause", "yes");
+        schedule_deep_pause();
+    }
+}
+
+void WallpaperOutput::schedule_deep_pause() {
+    if (args.deep_pause_s <= 0 || deep_paused) return;
+    if (deep_pause_timer_id > 0) g_source_remove(deep_pause_timer_id);
+    deep_pause_timer_id = g_timeout_add_seconds(args.deep_pause_s, on_deep_pause_timer, this);
+}
+
+gboolean WallpaperOutput::on_deep_pause_timer(gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    self->deep_pause_timer_id = 0;
+    if (self->is_paused && !self->prewarming) {
+        self->enter_deep_pause();
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Second pause tier: the file is unloaded (decoder, frame queue, hwdec
+// surfaces, audio output) and the render context with its textures and
+// shaders is freed. Only a snapshot of the last frame stays in VRAM, so
+// the surface can still be redrawn while the output remains covered.
+void WallpaperOutput::enter_deep_pause() {
+    if (own_offscreen) {
+        enter_offscreen_deep_pause();
+        return;
+    }
+    if (!mpv || !mpv_gl || deep_paused) return;
+
+    // A software surface keeps showing its last buffer, there is nothing to copy
+    if (!software_rendering()) {
+        if (!direct && !gtk_widget_get_realized(gl_area)) return;
+        if (!make_current()) return;
+
+        if (!take_snapshot()) {
+            std::cerr << "[" << name << "] No framebuffer blit support, staying in normal pause" << std::endl;
+            return;
+        }
+    }
+
+    rss_before_kb = resource_usage::rss_kb();
+    vram_before_kb = software_rendering() ? -1 : resource_usage::free_vram_kb();
+
+    double position = 0.0;
+    resume_position = mpv_get_property(mpv, "time-pos", MPV_FORMAT_DOUBLE, &position) >= 0 ? position : -1.0;
+    if (cache_playing) resume_position = cache_index * cache_frame_s;
+
+    // Unload first, so the VO is gone before its render context
+    const char *cmd[] = {"stop", nullptr};
+    mpv_command(mpv, cmd);
+    drop_frame_cache();
+    mpv_render_context_free(mpv_gl);
+    mpv_gl = nullptr;
+    free_scaled_fbo();
+    swap_pending = false;
+    deep_paused = true;
+
+    std::cout << "[" << name << "] Deep pause at " << std::max(resume_position, 0.0)
+              << "s: decoder and render context released" << std::endl;
+
+    // Give mpv's threads a moment to hand their memory back
+    if (deep_pause_report_id > 0) g_source_remove(deep_pause_report_id);
+    deep_pause_report_id = g_timeout_add_seconds(2, on_deep_pause_report, this);
+}
+
+// --render-thread without --shared-decoder: the output's own offscreen
+// decoder goes as a whole (mpv, its GL context, textures and thread) and
+// is recreated at the same position on resume
+void WallpaperOutput::enter_offscreen_deep_pause() {
+    if (deep_paused || !gtk_widget_get_realized(gl_area) || !make_current()) return;
+
+    if (!take_snapshot()) {
+        std::cerr << "[" << name << "] No framebuffer blit support, staying in normal pause" << std::endl;
+        return;
+    }
+
+    rss_before_kb = resource_usage::rss_kb();
+    vram_before_kb = resource_usage::free_vram_kb();
+    resume_position = own_offscreen->position();
+
+    free_offscreen_fbos();
+    offscreen->detach(this);
+    offscreen = nullptr;
+    own_offscreen.reset();
+    deep_paused = true;
+
+    std::cout << "[" << name << "] Deep pause at " << std::max(resume_position, 0.0)
+              << "s: offscreen decoder released" << std::endl;
+
+    if (deep_pause_report_id > 0) g_source_remove(deep_pause_report_id);
+    deep_pause_report_id = g_timeout_add_seconds(2, on_deep_pause_report, this);
+}
+
+gboolean WallpaperOutput::on_deep_pause_report(gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    self->deep_pause_report_id = 0;
+
+    int64_t rss_after_kb = resource_usage::rss_kb();
+    int64_t vram_after_kb = self->make_current() ? resource_usage::free_vram_kb() : -1;
+
+    auto mb = [](int64_t kb) { return kb < 0 ? std::string("n/a") : std::to_string(kb / 1024) + " MB"; };
+    std::cout << "[" << self->name << "] Deep pause: RSS " << mb(self->rss_before_kb) << " -> " << mb(rss_after_kb)
+              << ", free VRAM " << mb(self->vram_before_kb) << " -> " << mb(vram_after_kb) << std::endl;
+    return G_SOURCE_REMOVE;
+}
+
+// Recreates the render context and reloads the file at the recorded
+// position. The snapshot stays on screen until the first new frame.
+void WallpaperOutput::leave_deep_pause() {
+    if (!deep_paused) return;
+    deep_paused = false;
+
+    if (deep_pause_report_id > 0) {
+        g_source_remove(deep_pause_report_id);
+        deep_pause_report_id = 0;
+    }
+
+    // Deep paused with its own offscreen decoder, which attaches paused;
+    // the caller activates it
+    if (!mpv) {
+        own_offscreen = std::make_unique<OffscreenDecoder>(args, name);
+        own_offscreen->set_start(resume_position);
+        if (!own_offscreen->start(gdk_monitor_get_display(monitor), true)) {
+            std::cerr << "[" << name << "] Offscreen decoder could not be recreated" << std::endl;
+            own_offscreen.reset();
+            return;
+        }
+        offscreen = own_offscreen.get();
+        offscreen->attach(this);
+        reload_pending = true;
+        std::cout << "[" << name << "] Leaving deep pause at " << std::max(resume_position, 0.0) << "s" << std::endl;
+        return;
+    }
+
+    setup_rendering();
+    if (!mpv_gl) {
+        std::cerr << "[" << name << "] Render context could not be recreated" << std::endl;
+        return;
+    }
+
+    // "start" applies from the first frame, a seek after loading would show frame 0 first
+    if (resume_position > 0.0) {
+        char *previous = mpv_get_property_string(mpv, "start");
+        saved_start = previous ? previous : "none";
+        mpv_free(previous);
+        mpv_set_property_string(mpv, "start", std::to_string(resume_position).c_str());
+        restore_start = true;
+    }
+    reload_pending = true;
+
+    std::cout << "[" << name << "] Leaving deep pause at " << std::max(resume_position, 0.0) << "s" << std::endl;
+    load_video();
+}
+
+// Renders the frame on screen (mpv's, the offscreen decoder's or the cached
+// one) into a texture of the widget's size; the GL area's context has to
+// be current
+bool WallpaperOutput::take_snapshot() {
+    // Blitting the snapshot back needs framebuffer objects
+    if (!can_blit_framebuffers()) {
+        return false;
+    }
+
+    free_snapshot();
+    surface_size(snapshot_width, snapshot_height);
+    if (snapshot_width <= 0 || snapshot_height <= 0) return false;
+
+    GLint previous_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+
+    glGenTextures(1, &snapshot_texture);
+    glBindTexture(GL_TEXTURE_2D, snapshot_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, snapshot_width, snapshot_height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &snapshot_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, snapshot_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, snapshot_texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (complete) {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (cache_playing) {
+            // mpv is paused somewhere else, the cache has the frame on screen
+            frame_cache->draw(cache_index, snapshot_width, snapshot_height);
+        } else if (offscreen) {
+            draw_offscreen_frame(snapshot_width, snapshot_height);
+        } else {
+            // Same orientation as a regular render, so the blit copies it as is
+            mpv_opengl_fbo mpv_fbo{
+                .fbo = static_cast<int>(snapshot_fbo),
+                .w = snapshot_width,
+                .h = snapshot_height,
+                .internal_format = GL_RGBA8
+            };
+            int flip_y = 1;
+            mpv_render_param render_params[]{
+                {MPV_RENDER_PARAM_OPENGL_FBO, &mpv_fbo},
+                {MPV_RENDER_PARAM_FLIP_Y, &flip_y},
+                {MPV_RENDER_PARAM_INVALID, nullptr}
+            };
+            mpv_render_context_render(mpv_gl, render_params);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+    if (!complete) {
+        free_snapshot();
+        return false;
+    }
+    return true;
+}
+
+void WallpaperOutput::draw_snapshot(int width, int height) {
+    GLint target_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, snapshot_fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_fbo);
+    glBlitFramebuffer(0, 0, snapshot_width, snapshot_height, 0, 0, width, height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+}
+
+// Needs the GL area's context current
+void WallpaperOutput::free_snapshot() {
+    if (snapshot_fbo) {
+        glDeleteFramebuffers(1, &snapshot_fbo);
+        snapshot_fbo = 0;
+    }
+    if (snapshot_texture) {
+        glDeleteTextures(1, &snapshot_texture);
+        snapshot_texture = 0;
+    }
+}
+
+// --frame-cache needs this output's own mpv rendering through GL, and whole
+// loop passes reaching the renderer
+void WallpaperOutput::setup_frame_cache() {
+    if (args.frame_cache_mb <= 0) return;
+
+    const char *reason = nullptr;
+    if (software_rendering()) reason = "software rendering";
+    else if (args.skip_static) reason = "--skip-static";
+    else if (!args.loop) reason = "--no-loop";
+    else if (!args.mute) reason = "audio (--no-mute)";   // replay pauses mpv, audio included
+    else if (!can_blit_framebuffers()) reason = "no framebuffer blit support";
+    if (reason) {
+        std::cerr << "[" << name << "] Frame cache not used with " << reason << std::endl;
+        return;
+    }
+
+    frame_cache = std::make_unique<FrameCache>(static_cast<size_t>(args.frame_cache_mb) * 1024 * 1024);
+}
+
+const char *WallpaperOutput::frame_cache_state() const {
+    if (!frame_cache) return "off";
+    if (cache_playing) return "playing";
+    if (cache_recording) return "recording";
+    return "waiting";
+}
+
+// Playback (re)started at the beginning of the file: a recording that
+// spans a whole pass is complete, otherwise a new one starts
+void WallpaperOutput::on_loop_start() {
+    if (cache_playing) return;
+    if (cache_recording) {
+        finish_cache_recording();
+        if (cache_playing) return;
+    }
+
+    // Paused and reduced passes skip frames, a reload starts mid-file
+    if (is_paused.load(std::memory_order_relaxed) || is_reduced.load(std::memory_order_relaxed) ||
+        reload_pending) {
+        return;
+    }
+
+    cache_drops_start = dropped_frames(mpv);
+    cache_last_frame = -1;
+    cache_recording = true;
+    std::cout << "[" << name << "] Recording loop into the frame cache" << std::endl;
+}
+
+// Switches to replaying if every frame of the pass was recorded
+void WallpaperOutput::finish_cache_recording() {
+    double fps = 0.0, duration = 0.0;
+    if (mpv_get_property(mpv, "estimated-vf-fps", MPV_FORMAT_DOUBLE, &fps) < 0 || fps <= 0.0) {
+        mpv_get_property(mpv, "container-fps", MPV_FORMAT_DOUBLE, &fps);
+    }
+    mpv_get_property(mpv, "duration", MPV_FORMAT_DOUBLE, &duration);
+
+    // The first frame of this pass may have made it in before the restart
+    size_t expected = fps > 0.0 && duration > 0.0 ? static_cast<size_t>(std::llround(duration * fps)) : 0;
+    if (expected == 0) {
+        abandon_cache_recording("frame rate unknown");
+        return;
+    }
+    if (dropped_frames(mpv) > cache_drops_start || frame_cache->size() == 0 ||
+        frame_cache->size() + 1 < expected) {
+        abandon_cache_recording("frames were dropped");
+        return;
+    }
+
+    cache_recording = false;
+    if (frame_cache->size() > expected && make_current()) {
+        frame_cache->trim(expected);
+    }
+    cache_frame_s = duration / frame_cache->size();
+
+    mpv_set_property_string(mpv, "pause", "yes");
+    cache_playing = true;
+    cache_epoch = std::chrono::steady_clock::now();
+    cache_index = 0;
+    start_cache_tick();
+    request_render();
+
+    std::cout << "[" << name << "] Frame cache: " << frame_cache->size() << " frames, "
+              << frame_cache->bytes() / (1024 * 1024) << " MB, decoder paused" << std::endl;
+}
+
+// Playback keeps decoding; the next loop start records again
+void WallpaperOutput::abandon_cache_recording(const char *reason) {
+    cache_recording = false;
+    if (make_current()) frame_cache->clear();
+    std::cout << "[" << name << "] Frame cache recording abandoned: " << reason << std::endl;
+}
+
+// One-shot timer to when the next cached frame is due, or the reduced
+// rate's interval if that is later
+void WallpaperOutput::start_cache_tick() {
+    stop_cache_tick();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - cache_epoch).count();
+    double wait = (std::floor(elapsed / cache_frame_s) + 1.0) * cache_frame_s - elapsed;
+    wait = std::max(wait, min_frame_interval_us() / 1e6);
+    cache_tick_id = g_timeout_add(static_cast<guint>(std::ceil(wait * 1000.0)), on_cache_tick, this);
+}
+
+void WallpaperOutput::stop_cache_tick() {
+    if (cache_tick_id > 0) {
+        g_source_remove(cache_tick_id);
+        cache_tick_id = 0;
+    }
+}
+
+gboolean WallpaperOutput::on_cache_tick(gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    self->cache_tick_id = 0;
+    self->request_render();
+    self->start_cache_tick();
+    return G_SOURCE_REMOVE;
+}
+
+size_t WallpaperOutput::cache_frame_at(std::chrono::steady_clock::time_point now) const {
+    double elapsed = std::chrono::duration<double>(now - cache_epoch).count();
+    return static_cast<size_t>(std::max(0.0, elapsed / cache_frame_s)) % frame_cache->size();
+}
+
+// Back to decoding; needs the GL context current
+void WallpaperOutput::drop_frame_cache() {
+    stop_cache_tick();
+    if (frame_cache) frame_cache->clear();
+    cache_recording = false;
+    if (cache_playing) {
+        cache_playing = false;
+        if (mpv && !is_paused.load(std::memory_order_relaxed)) {
+            mpv_set_property_string(mpv, "pause", "no");
+        }
+    }
+}
+
+void WallpaperOutput::note_reveal() {
+    if (reveal_pending) return;
+    reveal_pending = true;
+    reveal_start = std::chrono::steady_clock::now();
+}
+
+// 0 when every frame may be rendered. The --fps interval allows some early
+// arrival, frames from the fps filter are already on that cadence.
+int64_t WallpaperOutput::min_frame_interval_us() const {
+    int64_t interval = args.fps > 0 ? 1000000 / args.fps * 9 / 10 : 0;
+    if (is_reduced.load(std::memory_order_relaxed)) {
+        interval = std::max(interval, REDUCED_FRAME_INTERVAL_US);
+    }
+    return interval;
+}
+
+void WallpaperOutput::set_reduced_rate(bool reduced) {
+    if (is_reduced == reduced) return;
+    is_reduced = reduced;
+    std::cout << "[" << name << "] Render rate " << (reduced ? "reduced" : "full") << std::endl;
+
+    // Frames skipped at the reduced rate would be missing from the recording
+    if (reduced && cache_recording) abandon_cache_recording("render rate reduced");
+    if (cache_tick_id > 0) start_cache_tick();
+}
+
+void WallpaperOutput::set_visibility(Visibility visibility) {
+    target = visibility;
+    bool pausing = visibility_paused(visibility) && !visibility_paused(applied);
+    bool resuming = !visibility_paused(visibility) && visibility_paused(applied);
+
+    if (!pausing && !resuming) {
+        // Back to the current pause state before the delay ran out
+        if (transition_timer_id > 0) {
+            g_source_remove(transition_timer_id);
+            transition_timer_id = 0;
+            transition_stats.avoided++;
+        }
+        if (visibility_paused(visibility)) {
+            end_prewarm();
+            reveal_pending = false;
+        }
+        apply_visibility(visibility);   // reduced <-> full rate is cheap, no delay
+        return;
+    }
+
+    // Nobody sees a powered-down or locked output, no reason to wait
+    if (visibility == Visibility::Off) {
+        if (transition_timer_id > 0) {
+            g_source_remove(transition_timer_id);
+            transition_timer_id = 0;
+        }
+        apply_visibility(visibility);
+        return;
+    }
+
+    if (resuming) note_reveal();
+    if (transition_timer_id > 0) return;   // already waiting, the timer applies the new target
+
+    guint delay = pausing ? args.pause_delay_ms : args.resume_delay_ms;
+    if (delay == 0) {
+        apply_visibility(visibility);
+        return;
+    }
+    transition_timer_id = g_timeout_add(delay, on_transition_timer, this);
+}
+
+gboolean WallpaperOutput::on_transition_timer(gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    self->transition_timer_id = 0;
+    self->apply_visibility(self->target);
+    return G_SOURCE_REMOVE;
+}
+
+void WallpaperOutput::apply_visibility(Visibility visibility) {
+    applied = visibility;
+
+    switch (visibility) {
+    case Visibility::Off:
+    case Visibility::Hidden:
+        pause_video();
+        break;
+    case Visibility::Partial:
+        set_reduced_rate(true);
+        resume_video();
+        break;
+    case Visibility::Visible:
+        set_reduced_rate(false);
+        resume_video();
+        break;
+    }
+}
+
+void WallpaperOutput::setup_window() {
+    window = GTK_WINDOW(gtk_application_window_new(app));
+    gtk_window_set_title(window, "vidwall");
+
+    gtk_layer_init_for_window(window);
+    gtk_layer_set_layer(window, GTK_LAYER_SHELL_LAYER_BACKGROUND);
+    gtk_layer_set_monitor(window, monitor);
+    gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_LEFT, TRUE);
+    gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_RIGHT, TRUE);
+    gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_TOP, TRUE);
+    gtk_layer_set_anchor(window, GTK_LAYER_SHELL_EDGE_BOTTOM, TRUE);
+    gtk_layer_set_exclusive_zone(window, -1);
+
+    gl_area = gtk_gl_area_new();
+    gtk_gl_area_set_required_version(GTK_GL_AREA(gl_area), 2, 1);
+    gtk_gl_area_set_auto_render(GTK_GL_AREA(gl_area), FALSE);
+
+    g_signal_connect(gl_area, "realize", G_CALLBACK(on_gl_realize), this);
+    g_signal_connect(gl_area, "render", G_CALLBACK(on_gl_render), this);
+    g_signal_connect(gl_area, "unrealize", G_CALLBACK(on_gl_unrealize), this);
+
+    gtk_window_set_child(window, gl_area);
+    gtk_window_present(window);
+
+    std::cout << "[" << name << "] Window ready" << std::endl;
+}
+
+void WallpaperOutput::setup_mpv() {
+    mpv = mpv_create();
+    if (!mpv) {
+        std::cerr << "Failed to create mpv" << std::endl;
+        return;
+    }
+
+    apply_mpv_options(mpv, args);
+
+    // Outputs that start covered never begin decoding
+    if (is_paused) {
+        mpv_set_option_string(mpv, "pause", "yes");
+    }
+
+    if (mpv_initialize(mpv) < 0) {
+        std::cerr << "Failed to initialize mpv" << std::endl;
+        mpv_terminate_destroy(mpv);
+        mpv = nullptr;
+        return;
+    }
+
+    video_location = memory_source::register_protocol(mpv, args.video_path);
+
+    // Events are handled as soon as mpv queues them, nothing polls
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd < 0) {
+        std::cerr << "Failed to create mpv wakeup fd" << std::endl;
+        mpv_terminate_destroy(mpv);
+        mpv = nullptr;
+        return;
+    }
+    wakeup_watch_id = g_unix_fd_add(wakeup_fd, G_IO_IN, on_mpv_wakeup_ready, this);
+    mpv_set_wakeup_callback(mpv, on_mpv_wakeup, this);
+
+    std::cout << "[" << name << "] MPV ready" << std::endl;
+    if (!args.mute) std::cout << "  Audio: enabled (50% volume)" << std::endl;
+    if (args.loop) std::cout << "  Loop: enabled" << std::endl;
+}
+
+void WallpaperOutput::setup_rendering() {
+    if (software_rendering()) {
+        setup_sw_rendering();
+    } else {
+        setup_gl_rendering();
+    }
+}
+
+void WallpaperOutput::setup_gl_rendering() {
+    if (!make_current()) {
+        std::cerr << "GL error" << std::endl;
+        return;
+    }
+
+    mpv_opengl_init_params gl_init_params{
+        .get_proc_address = get_proc_address,
+        .get_proc_address_ctx = nullptr
+    };
+
+    mpv_render_param params[]{
+        {MPV_RENDER_PARAM_API_TYPE, const_cast<char*>(MPV_RENDER_API_TYPE_OPENGL)},
+        {MPV_RENDER_PARAM_OPENGL_INIT_PARAMS, &gl_init_params},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    if (mpv_render_context_create(&mpv_gl, mpv, params) < 0) {
+        std::cerr << "Render context failed" << std::endl;
+        return;
+    }
+
+    mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, this);
+
+    std::cout << "[" << name << "] GL rendering ready (" << (direct ? "layer surface" : "frame clock") << ")" << std::endl;
+}
+
+// mpv's CPU renderer: scaling and conversion straight into shm buffers,
+// without emulating GL on the CPU
+void WallpaperOutput::setup_sw_rendering() {
+    mpv_render_param params[]{
+        {MPV_RENDER_PARAM_API_TYPE, const_cast<char*>(MPV_RENDER_API_TYPE_SW)},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    if (mpv_render_context_create(&mpv_gl, mpv, params) < 0) {
+        std::cerr << "Software render context failed" << std::endl;
+        return;
+    }
+
+    mpv_render_context_set_update_callback(mpv_gl, on_mpv_render_update, this);
+
+    std::cout << "[" << name << "] Software rendering ready (layer surface)" << std::endl;
+}
+
+void WallpaperOutput::load_video() {
+    if (!mpv) return;
+    const char *cmd[] = {"loadfile", video_location.c_str(), nullptr};
+    mpv_command_async(mpv, 0, cmd);
+    std::cout << "[" << name << "] Loading: " << args.video_path
+              << (video_location != args.video_path ? " (from memory)" : "") << std::endl;
+}
+
+void WallpaperOutput::on_gl_realize(GtkGLArea *area, gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+
+    // after-paint marks the end of a frame clock cycle, i.e. the buffer swap
+    self->frame_clock = gtk_widget_get_frame_clock(GTK_WIDGET(area));
+    if (self->frame_clock) {
+        self->after_paint_id = g_signal_connect(self->frame_clock, "after-paint",
+                                                G_CALLBACK(on_after_paint), self);
+    }
+}
+
+gboolean WallpaperOutput::on_gl_render(GtkGLArea *area, GdkGLContext *context, gpointer user_data) {
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+    (void)context;
+
+    if (!self->mpv_gl && !self->offscreen && !self->snapshot_fbo) return FALSE;
+
+    self->draw(gtk_widget_get_width(GTK_WIDGET(area)), gtk_widget_get_height(GTK_WIDGET(area)));
+    return TRUE;
+}
+
+// Draws into the bound framebuffer, the GL area's or a direct surface's
+// window buffer, or into pixels with software rendering. False if nothing
+// new was drawn.
+bool WallpaperOutput::draw(int width, int height, void *pixels, size_t stride) {
+    // Deep paused, or reloading after it: redraw the last frame. Software
+    // surfaces leave their last buffer attached instead.
+    if (snapshot_fbo && (deep_paused || reload_pending)) {
+        draw_snapshot(width, height);
+        return true;
+    }
+    if (pixels && reload_pending) return false;
+
+    if ((!mpv_gl && !offscreen) || is_paused.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    // The cached frames carry the bars of the size they were rendered for
+    if (cache_playing && (width != cache_width || height != cache_height)) {
+        std::cout << "[" << name << "] Surface resized, frame cache dropped" << std::endl;
+        drop_frame_cache();
+    }
+
+    auto render_start = std::chrono::steady_clock::now();
+    if (offscreen) {
+        if (!draw_offscreen_frame(width, height)) return false;
+    } else if (cache_playing) {
+        cache_index = cache_frame_at(render_start);
+        frame_cache->draw(cache_index, width, height);
+    } else if (pixels) {
+        draw_sw_frame(width, height, pixels, stride);
+    } else {
+        draw_mpv_frame(width, height);
+    }
+    uint64_t render_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - render_start).count();
+    render_time_total_us += render_us;
+    render_time_max_us = std::max(render_time_max_us, render_us);
+    render_time_frames++;
+
+    auto now = std::chrono::steady_clock::now();
+    if (loop_restart) {
+        loop_restart = false;
+        uint64_t seam_us = std::chrono::duration_cast<std::chrono::microseconds>(now - last_frame_render).count();
+        loops++;
+        seam_total_us += seam_us;
+        seam_max_us = std::max(seam_max_us, seam_us);
+    }
+    render_count.fetch_add(1, std::memory_order_relaxed);
+    last_frame_render = now;
+    swap_pending = true;
+
+    if (snapshot_fbo) {
+        free_snapshot();
+    }
+
+    if (reveal_pending) {
+        auto latency = std::chrono::steady_clock::now() - reveal_start;
+        uint64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        reveal_pending = false;
+        transition_stats.reveals++;
+        reveal_total_us += latency_us;
+        transition_stats.max_reveal_ms = std::max(transition_stats.max_reveal_ms, latency_us / 1000.0);
+    }
+
+    return true;
+}
+
+void WallpaperOutput::draw_mpv_frame(int width, int height) {
+    gpu_timer.begin();
+
+    int fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+
+    double scale = render_scale(width, height);
+    bool scaled = scale < 1.0 && ensure_scaled_fbo(std::max(1, static_cast<int>(width * scale + 0.5)),
+                                                   std::max(1, static_cast<int>(height * scale + 0.5)));
+    if (!scaled) free_scaled_fbo();
+
+    // While recording, mpv renders into the next cached frame, which is
+    // then blitted like a scaled render
+    int render_width = scaled ? scaled_width : width;
+    int render_height = scaled ? scaled_height : height;
+    unsigned int record_fbo = 0;
+    // Redraws of a frame already recorded (resume, resize) render as usual
+    int64_t frame = -1;
+    if (cache_recording && (mpv_get_property(mpv, "estimated-frame-number", MPV_FORMAT_INT64, &frame) < 0 ||
+                            frame != cache_last_frame)) {
+        cache_last_frame = frame;
+        if (frame_cache->size() == 0) {
+            cache_width = width;
+            cache_height = height;
+        }
+        if (width == cache_width && height == cache_height) {
+            record_fbo = frame_cache->add_frame(render_width, render_height);
+        }
+        if (!record_fbo) abandon_cache_recording("over the memory budget or resized");
+    }
+    unsigned int offscreen_fbo = record_fbo ? record_fbo : scaled ? scaled_fbo : 0;
+
+    // mpv covers every pixel itself when the bars are opaque black, and
+    // the blit replaces all of them
+    if (!args.opaque && !offscreen_fbo) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    // Same orientation as a direct render, so the blit copies it as is
+    mpv_opengl_fbo mpv_fbo{
+        .fbo = offscreen_fbo ? static_cast<int>(offscreen_fbo) : fbo,
+        .w = render_width,
+        .h = render_height,
+        .internal_format = offscreen_fbo ? GL_RGBA8 : 0
+    };
+
+    int flip_y = 1;
+    int block = 0;
+
+    mpv_render_param render_params[]{
+        {MPV_RENDER_PARAM_OPENGL_FBO, &mpv_fbo},
+        {MPV_RENDER_PARAM_FLIP_Y, &flip_y},
+        {MPV_RENDER_PARAM_BLOCK_FOR_TARGET_TIME, &block},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    mpv_render_context_render(mpv_gl, render_params);
+
+    if (offscreen_fbo) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen_fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+
+    gpu_timer.end();
+}
+
+// --render-scale, or with auto the share at which the frame has no more
+// pixels than the video in either direction
+double WallpaperOutput::render_scale(int width, int height) const {
+    if (args.render_scale > 0.0) return args.render_scale;
+    if (last_video_width <= 0 || last_video_height <= 0 || width <= 0 || height <= 0) return 1.0;
+    return std::min(1.0, std::max(static_cast<double>(last_video_width) / width,
+                                  static_cast<double>(last_video_height) / height));
+}
+
+bool WallpaperOutput::ensure_scaled_fbo(int width, int height) {
+    if (scaled_fbo && scaled_width == width && scaled_height == height) return true;
+    free_scaled_fbo();
+    if (!can_blit_framebuffers()) return false;
+
+    GLint previous_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+
+    glGenTextures(1, &scaled_texture);
+    glBindTexture(GL_TEXTURE_2D, scaled_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &scaled_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, scaled_fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scaled_texture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+
+    if (!complete) {
+        std::cerr << "[" << name << "] Render scale framebuffer " << width << "x" << height
+                  << " unusable, rendering at full size" << std::endl;
+        free_scaled_fbo();
+        return false;
+    }
+
+    scaled_width = width;
+    scaled_height = height;
+    std::cout << "[" << name << "] Rendering at " << width << "x" << height << ", upscaled" << std::endl;
+    return true;
+}
+
+void WallpaperOutput::free_scaled_fbo() {
+    if (scaled_fbo) {
+        glDeleteFramebuffers(1, &scaled_fbo);
+        scaled_fbo = 0;
+    }
+    if (scaled_texture) {
+        glDeleteTextures(1, &scaled_texture);
+        scaled_texture = 0;
+    }
+    scaled_width = scaled_height = 0;
+}
+
+// XRGB8888 is B, G, R, X in memory on little-endian machines: "bgr0" to mpv
+void WallpaperOutput::draw_sw_frame(int width, int height, void *pixels, size_t stride) {
+    int size[2] = {width, height};
+    char format[] = "bgr0";
+
+    mpv_render_param render_params[]{
+        {MPV_RENDER_PARAM_SW_SIZE, size},
+        {MPV_RENDER_PARAM_SW_FORMAT, format},
+        {MPV_RENDER_PARAM_SW_STRIDE, &stride},
+        {MPV_RENDER_PARAM_SW_POINTER, pixels},
+        {MPV_RENDER_PARAM_INVALID, nullptr}
+    };
+
+    mpv_render_context_render(mpv_gl, render_params);
+}
+
+// Scales the offscreen decoder's latest frame onto this surface, keeping
+// its aspect ratio like mpv does. False before the first frame.
+bool WallpaperOutput::draw_offscreen_frame(int width, int height) {
+    OffscreenDecoder::Frame frame;
+    if (!offscreen->acquire_frame(frame)) return false;
+
+    // Framebuffer objects are per context, the textures behind them are shared
+    if (offscreen_generation != frame.generation) {
+        free_offscreen_fbos();
+        glGenFramebuffers(OffscreenDecoder::SLOTS, offscreen_read_fbo);
+        for (int i = 0; i < OffscreenDecoder::SLOTS; i++) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen_read_fbo[i]);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                   frame.textures[i], 0);
+        }
+        offscreen_generation = frame.generation;
+    }
+
+    double scale = std::min(static_cast<double>(width) / frame.width,
+                            static_cast<double>(height) / frame.height);
+    int dst_width = static_cast<int>(frame.width * scale + 0.5);
+    int dst_height = static_cast<int>(frame.height * scale + 0.5);
+    int dst_x = (width - dst_width) / 2;
+    int dst_y = (height - dst_height) / 2;
+
+    GLint target_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen_read_fbo[frame.slot]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_fbo);
+    glBlitFramebuffer(0, 0, frame.width, frame.height,
+                      dst_x, dst_y, dst_x + dst_width, dst_y + dst_height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+
+    offscreen->release_frame(frame);
+    return true;
+}
+
+// Needs the GL area's context current
+void WallpaperOutput::free_offscreen_fbos() {
+    if (offscreen_read_fbo[0]) {
+        glDeleteFramebuffers(OffscreenDecoder::SLOTS, offscreen_read_fbo);
+        std::fill(std::begin(offscreen_read_fbo), std::end(offscreen_read_fbo), 0);
+    }
+    offscreen_generation = 0;
+}
+
+void WallpaperOutput::on_gl_unrealize(GtkGLArea *area, gpointer user_data) {
+    (void)area;
+    auto *self = static_cast<WallpaperOutput*>(user_data);
+
+    if (self->after_paint_id > 0) {
+        g_signal_handler_disconnect(self->frame_clock, self->after_paint_id);
+        self->after_paint_id = 0;
+        self->frame_clock = nullptr;
+    }
+
+    gtk_gl_area_make_current(GTK_GL_AREA(self->gl_area));
+    self->free_snapshot();
+    self->free_offscreen_fbos();
+    self->free_scaled_fbo();
+    self->drop_frame_cache();
+    self->gpu_timer.release();
+
+    if (self->mpv_gl) {
+        mpv_render_context_free(self->mpv_gl);
+        self->mpv_gl = nullptr;
+    }
+}
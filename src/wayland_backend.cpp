@@ -0,0 +1,538 @@
+#include "../include/wayland_backend.h"
+#include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include <glib-unix.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+const wl_registry_listener WaylandConnection::registry_listener = {
+    on_global,
+    on_global_remove
+};
+
+const wl_output_listener WaylandConnection::output_listener = {
+    on_output_geometry,
+    on_output_mode,
+    on_output_done,
+    on_output_scale,
+    on_output_name,
+    on_output_description
+};
+
+WaylandConnection::~WaylandConnection() {
+    if (watch_id > 0) g_source_remove(watch_id);
+
+    if (egl_display != EGL_NO_DISPLAY) {
+        eglTerminate(egl_display);
+    }
+    for (auto& output : outputs) {
+        wl_output_destroy(output->output);
+    }
+    outputs.clear();
+    if (layer_shell) {
+        // The destroy request only exists from version 3
+        if (layer_shell_version >= 3) {
+            zwlr_layer_shell_v1_destroy(layer_shell);
+        } else {
+            wl_proxy_destroy(reinterpret_cast<wl_proxy*>(layer_shell));
+        }
+    }
+    if (shm) wl_shm_destroy(shm);
+    if (compositor) wl_compositor_destroy(compositor);
+    if (registry) wl_registry_destroy(registry);
+    if (display) wl_display_disconnect(display);
+}
+
+bool WaylandConnection::connect(bool egl) {
+    display = wl_display_connect(nullptr);
+    if (!display) {
+        std::cerr << "[wayland] Cannot connect to the compositor" << std::endl;
+        return false;
+    }
+
+    registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry, &registry_listener, this);
+    // Globals first, then the outputs' names and scales
+    wl_display_roundtrip(display);
+    wl_display_roundtrip(display);
+
+    if (!compositor || !layer_shell) {
+        std::cerr << "[wayland] Compositor lacks " << (compositor ? "zwlr_layer_shell_v1" : "wl_compositor") << std::endl;
+        return false;
+    }
+
+    if (!egl && !shm) {
+        std::cerr << "[wayland] Compositor lacks wl_shm" << std::endl;
+        return false;
+    }
+    if (egl && !setup_egl()) return false;
+
+    watch_id = g_unix_fd_add(wl_display_get_fd(display), G_IO_IN, on_display_readable, this);
+    std::cout << "[wayland] Connected, " << outputs.size() << " output(s)" << std::endl;
+    return true;
+}
+
+// Desktop GL when available, like GTK, else GLES 2
+bool WaylandConnection::setup_egl() {
+    egl_display = eglGetPlatformDisplay(EGL_PLATFORM_WAYLAND_KHR, display, nullptr);
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, nullptr, nullptr)) {
+        std::cerr << "[wayland] EGL initialization failed" << std::endl;
+        egl_display = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    const EGLenum apis[] = {EGL_OPENGL_API, EGL_OPENGL_ES_API};
+    const EGLint renderable[] = {EGL_OPENGL_BIT, EGL_OPENGL_ES2_BIT};
+    for (int i = 0; i < 2; i++) {
+        const EGLint attribs[] = {
+            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_RENDERABLE_TYPE, renderable[i],
+            EGL_NONE
+        };
+        EGLint count = 0;
+        if (eglBindAPI(apis[i]) && eglChooseConfig(egl_display, attribs, &egl_config, 1, &count) && count > 0) {
+            egl_api = apis[i];
+            swap_with_damage_khr = epoxy_has_egl_extension(egl_display, "EGL_KHR_swap_buffers_with_damage");
+            swap_with_damage_ext = epoxy_has_egl_extension(egl_display, "EGL_EXT_swap_buffers_with_damage");
+            return true;
+        }
+    }
+
+    std::cerr << "[wayland] No usable EGL config" << std::endl;
+    return false;
+}
+
+// Damage rects are x, y, width, height with a bottom-left origin
+void WaylandConnection::swap_buffers(EGLSurface surface, EGLint *rects, EGLint count) const {
+    if (rects && swap_with_damage_khr) {
+        eglSwapBuffersWithDamageKHR(egl_display, surface, rects, count);
+    } else if (rects && swap_with_damage_ext) {
+        eglSwapBuffersWithDamageEXT(egl_display, surface, rects, count);
+    } else {
+        eglSwapBuffers(egl_display, surface);
+    }
+}
+
+wl_output *WaylandConnection::find_output(const std::string& name, int32_t& scale) const {
+    for (auto& output : outputs) {
+        if (output->name == name) {
+            scale = output->scale;
+            return output->output;
+        }
+    }
+    return nullptr;
+}
+
+void WaylandConnection::dispatch_pending() {
+    wl_display_dispatch_pending(display);
+    wl_display_flush(display);
+}
+
+gboolean WaylandConnection::on_display_readable(gint fd, GIOCondition condition, gpointer user_data) {
+    (void)fd;
+    (void)condition;
+    auto *self = static_cast<WaylandConnection*>(user_data);
+
+    if (wl_display_dispatch(self->display) < 0) {
+        std::cerr << "[wayland] Connection lost" << std::endl;
+        self->watch_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void WaylandConnection::on_global(void *data, wl_registry *registry, uint32_t name, const char *interface,
+                                  uint32_t version) {
+    auto *self = static_cast<WaylandConnection*>(data);
+
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        self->compositor = static_cast<wl_compositor*>(
+            wl_registry_bind(registry, name, &wl_compositor_interface, std::min(version, 4u)));
+    } else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
+        self->layer_shell_version = std::min(version, 3u);
+        self->layer_shell = static_cast<zwlr_layer_shell_v1*>(
+            wl_registry_bind(registry, name, &zwlr_layer_shell_v1_interface, self->layer_shell_version));
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        // Every compositor supports XRGB8888, no need to wait for format events
+        self->shm = static_cast<wl_shm*>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+    } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        // v4 names the output after its connector, which is how outputs are matched
+        auto output = std::make_unique<Output>();
+        output->global = name;
+        output->output = static_cast<wl_output*>(
+            wl_registry_bind(registry, name, &wl_output_interface, std::min(version, 4u)));
+        wl_output_add_listener(output->output, &output_listener, output.get());
+        self->outputs.push_back(std::move(output));
+    }
+}
+
+void WaylandConnection::on_global_remove(void *data, wl_registry *registry, uint32_t name) {
+    (void)registry;
+    auto *self = static_cast<WaylandConnection*>(data);
+
+    std::erase_if(self->outputs, [name](const std::unique_ptr<Output>& output) {
+        if (output->global != name) return false;
+        wl_output_destroy(output->output);
+        return true;
+    });
+}
+
+void WaylandConnection::on_output_geometry(void *, wl_output *, int32_t, int32_t, int32_t, int32_t, int32_t,
+                                           const char *, const char *, int32_t) {}
+
+void WaylandConnection::on_output_mode(void *, wl_output *, uint32_t, int32_t, int32_t, int32_t) {}
+
+void WaylandConnection::on_output_done(void *, wl_output *) {}
+
+void WaylandConnection::on_output_scale(void *data, wl_output *output, int32_t factor) {
+    (void)output;
+    static_cast<Output*>(data)->scale = factor;
+}
+
+void WaylandConnection::on_output_name(void *data, wl_output *output, const char *name) {
+    (void)output;
+    static_cast<Output*>(data)->name = name;
+}
+
+void WaylandConnection::on_output_description(void *, wl_output *, const char *) {}
+
+WaylandSurface::WaylandSurface(WaylandConnection& connection, const std::string& output_name, bool software,
+                               DrawCallback draw, PresentCallback presented)
+    : connection(connection), output_name(output_name), software_buffers(software),
+      draw(std::move(draw)), presented(std::move(presented)) {}
+
+WaylandSurface::~WaylandSurface() {
+    if (render_idle_id > 0) g_source_remove(render_idle_id);
+    if (frame_callback) wl_callback_destroy(frame_callback);
+
+    EGLDisplay egl_display = connection.get_egl_display();
+    if (egl_context != EGL_NO_CONTEXT || egl_surface != EGL_NO_SURFACE) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    if (egl_surface != EGL_NO_SURFACE) eglDestroySurface(egl_display, egl_surface);
+    if (egl_context != EGL_NO_CONTEXT) eglDestroyContext(egl_display, egl_context);
+    if (egl_window) wl_egl_window_destroy(egl_window);
+    for (ShmBuffer& shm_buffer : shm_buffers) {
+        free_shm_buffer(shm_buffer);
+    }
+    if (layer_surface) zwlr_layer_surface_v1_destroy(layer_surface);
+    if (surface) wl_surface_destroy(surface);
+    wl_display_flush(connection.get_display());
+}
+
+bool WaylandSurface::create() {
+    wl_output *output = connection.find_output(output_name, scale);
+    if (!output) {
+        std::cerr << "[" << output_name << "] No matching wl_output" << std::endl;
+        return false;
+    }
+
+    static const zwlr_layer_surface_v1_listener listener = {on_configure, on_closed};
+
+    surface = wl_compositor_create_surface(connection.get_compositor());
+    wl_surface_set_buffer_scale(surface, scale);
+    layer_surface = zwlr_layer_shell_v1_get_layer_surface(connection.get_layer_shell(), surface, output,
+                                                          ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND, "vidwall");
+    zwlr_layer_surface_v1_add_listener(layer_surface, &listener, this);
+    zwlr_layer_surface_v1_set_anchor(layer_surface,
+                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+    zwlr_layer_surface_v1_set_exclusive_zone(layer_surface, -1);
+    zwlr_layer_surface_v1_set_keyboard_interactivity(layer_surface,
+                                                     ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_NONE);
+    wl_surface_commit(surface);
+
+    // The first configure carries the size the EGL window needs
+    while (!configured && !closed) {
+        if (wl_display_roundtrip(connection.get_display()) < 0) break;
+    }
+    if (!configured || width <= 0 || height <= 0) {
+        std::cerr << "[" << output_name << "] Layer surface was not configured" << std::endl;
+        return false;
+    }
+
+    if (!software_buffers && !setup_egl()) return false;
+
+    std::cout << "[" << output_name << "] Layer surface ready (" << width << "x" << height
+              << " @" << scale << "x, " << (software_buffers ? "shm" : "EGL") << ")" << std::endl;
+    return true;
+}
+
+bool WaylandSurface::setup_egl() {
+    EGLDisplay egl_display = connection.get_egl_display();
+
+    eglBindAPI(connection.get_egl_api());
+    const EGLint es_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+    egl_context = eglCreateContext(egl_display, connection.get_egl_config(), EGL_NO_CONTEXT,
+                                   connection.get_egl_api() == EGL_OPENGL_ES_API ? es_attribs : nullptr);
+    if (egl_context == EGL_NO_CONTEXT) {
+        std::cerr << "[" << output_name << "] EGL context failed" << std::endl;
+        return false;
+    }
+
+    egl_window = wl_egl_window_create(surface, get_buffer_width(), get_buffer_height());
+    egl_surface = eglCreatePlatformWindowSurface(egl_display, connection.get_egl_config(), egl_window, nullptr);
+    if (egl_surface == EGL_NO_SURFACE) {
+        std::cerr << "[" << output_name << "] EGL window surface failed" << std::endl;
+        return false;
+    }
+
+    // Frames are paced by our own frame callbacks, a blocking swap would stall the main loop
+    if (!make_current()) return false;
+    eglSwapInterval(egl_display, 0);
+    return true;
+}
+
+// GTK tracks which of its GL contexts is current and skips redundant
+// switches, so its record is cleared before taking over the thread
+bool WaylandSurface::make_current() {
+    if (egl_context == EGL_NO_CONTEXT) return false;
+    gdk_gl_context_clear_current();
+    return eglMakeCurrent(connection.get_egl_display(), egl_surface, egl_surface, egl_context);
+}
+
+void WaylandSurface::queue_render() {
+    render_requested = true;
+    if (frame_callback || render_idle_id > 0) return;   // drawn when the compositor is ready
+    render_idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, on_render_idle, this, nullptr);
+}
+
+gboolean WaylandSurface::on_render_idle(gpointer user_data) {
+    auto *self = static_cast<WaylandSurface*>(user_data);
+    self->render_idle_id = 0;
+    self->render();
+    return G_SOURCE_REMOVE;
+}
+
+void WaylandSurface::render() {
+    if (!render_requested || !configured || closed) return;
+    if (!software_buffers && egl_surface == EGL_NO_SURFACE) return;
+    render_requested = false;
+
+    Target target{get_buffer_width(), get_buffer_height(), nullptr, 0, {}};
+    target.content = content_rect(target.width, target.height);
+    ShmBuffer *shm_buffer = nullptr;
+    if (software_buffers) {
+        shm_buffer = acquire_shm_buffer(target.width, target.height);
+        if (!shm_buffer) {
+            // All buffers are on screen; drawn when one is released
+            render_requested = true;
+            return;
+        }
+        target.pixels = shm_buffer->data;
+        target.stride = shm_buffer->stride;
+
+        // Only the video part is rendered; bars of an earlier layout are
+        // blacked out once per buffer (XRGB8888 zero)
+        if (shm_buffer->content != target.content) {
+            memset(shm_buffer->data, 0, shm_buffer->size);
+            shm_buffer->content = target.content;
+        }
+    } else if (!make_current()) {
+        return;
+    }
+
+    if (!draw(target)) return;
+
+    static const wl_callback_listener frame_listener = {on_frame_done};
+    frame_callback = wl_surface_frame(surface);
+    wl_callback_add_listener(frame_callback, &frame_listener, this);
+
+    if (shm_buffer) {
+        wl_surface_attach(surface, shm_buffer->buffer, 0, 0);
+        shm_buffer->busy = true;
+    }
+    commit_damage(target);
+    presented();
+    connection.dispatch_pending();
+}
+
+// The video's part of the buffer, fitted and centered like mpv does
+WaylandSurface::Rect WaylandSurface::content_rect(int buffer_width, int buffer_height) const {
+    Rect rect{0, 0, buffer_width, buffer_height};
+    if (!opaque_content || video_width <= 0 || video_height <= 0) return rect;
+
+    double fit = std::min(static_cast<double>(buffer_width) / video_width,
+                          static_cast<double>(buffer_height) / video_height);
+    rect.width = std::clamp(static_cast<int>(video_width * fit + 0.5), 1, buffer_width);
+    rect.height = std::clamp(static_cast<int>(video_height * fit + 0.5), 1, buffer_height);
+    rect.x = (buffer_width - rect.width) / 2;
+    rect.y = (buffer_height - rect.height) / 2;
+    return rect;
+}
+
+// The whole buffer after a resize or a layout change, the video part
+// otherwise. Commits the surface (through the swap with EGL).
+void WaylandSurface::commit_damage(const Target& target) {
+    if (target.content != last_content) {
+        last_content = target.content;
+        full_damage = true;
+    }
+    Rect damage = full_damage ? Rect{0, 0, target.width, target.height} : target.content;
+    full_damage = false;
+
+    if (software_buffers) {
+        if (wl_surface_get_version(surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+            wl_surface_damage_buffer(surface, damage.x, damage.y, damage.width, damage.height);
+        } else {
+            // Surface coordinates, rounded outwards
+            int x0 = damage.x / scale;
+            int y0 = damage.y / scale;
+            int x1 = (damage.x + damage.width + scale - 1) / scale;
+            int y1 = (damage.y + damage.height + scale - 1) / scale;
+            wl_surface_damage(surface, x0, y0, x1 - x0, y1 - y0);
+        }
+        wl_surface_commit(surface);
+        return;
+    }
+
+    // Attaches, damages and commits the buffer; mpv redraws all of it,
+    // so the hint is only for the compositor
+    if (!opaque_content || !connection.can_swap_with_damage()) {
+        connection.swap_buffers(egl_surface, nullptr, 0);
+        return;
+    }
+    EGLint rect[4] = {damage.x, target.height - damage.y - damage.height, damage.width, damage.height};
+    connection.swap_buffers(egl_surface, rect, 1);
+}
+
+void WaylandSurface::set_video_size(int64_t new_width, int64_t new_height) {
+    video_width = new_width;
+    video_height = new_height;
+    queue_render();
+}
+
+// Background layer: nothing has to be blended underneath it
+void WaylandSurface::set_opaque_region() {
+    wl_region *region = wl_compositor_create_region(connection.get_compositor());
+    wl_region_add(region, 0, 0, width, height);
+    wl_surface_set_opaque_region(surface, region);
+    wl_region_destroy(region);
+}
+
+// A free buffer of this size, reusing or reallocating idle ones first
+WaylandSurface::ShmBuffer *WaylandSurface::acquire_shm_buffer(int buffer_width, int buffer_height) {
+    ShmBuffer *idle = nullptr;
+    for (ShmBuffer& shm_buffer : shm_buffers) {
+        if (shm_buffer.busy) continue;
+        if (shm_buffer.buffer && shm_buffer.width == buffer_width && shm_buffer.height == buffer_height) {
+            return &shm_buffer;
+        }
+        // Prefer a stale buffer over an empty slot, so resizing does not grow the set
+        if (!idle || (shm_buffer.buffer && !idle->buffer)) idle = &shm_buffer;
+    }
+    if (!idle) return nullptr;
+
+    free_shm_buffer(*idle);
+    if (!allocate_shm_buffer(*idle, buffer_width, buffer_height)) return nullptr;
+    return idle;
+}
+
+bool WaylandSurface::allocate_shm_buffer(ShmBuffer& shm_buffer, int buffer_width, int buffer_height) {
+    // mpv's software renderer wants 64-byte aligned rows
+    size_t stride = (static_cast<size_t>(buffer_width) * 4 + 63) & ~static_cast<size_t>(63);
+    size_t size = stride * buffer_height;
+
+    int fd = memfd_create("vidwall-shm", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) < 0) {
+        std::cerr << "[" << output_name << "] Cannot allocate a shm buffer" << std::endl;
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "[" << output_name << "] Cannot map a shm buffer" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    static const wl_buffer_listener buffer_listener = {on_buffer_release};
+
+    wl_shm_pool *pool = wl_shm_create_pool(connection.get_shm(), fd, static_cast<int32_t>(size));
+    shm_buffer.buffer = wl_shm_pool_create_buffer(pool, 0, buffer_width, buffer_height,
+                                                  static_cast<int32_t>(stride), WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    shm_buffer.owner = this;
+    shm_buffer.data = data;
+    shm_buffer.size = size;
+    shm_buffer.width = buffer_width;
+    shm_buffer.height = buffer_height;
+    shm_buffer.stride = stride;
+    shm_buffer.busy = false;
+    wl_buffer_add_listener(shm_buffer.buffer, &buffer_listener, &shm_buffer);
+    return true;
+}
+
+void WaylandSurface::free_shm_buffer(ShmBuffer& shm_buffer) {
+    if (shm_buffer.buffer) wl_buffer_destroy(shm_buffer.buffer);
+    if (shm_buffer.data) munmap(shm_buffer.data, shm_buffer.size);
+    WaylandSurface *owner = shm_buffer.owner;
+    shm_buffer = ShmBuffer{};
+    shm_buffer.owner = owner;
+}
+
+void WaylandSurface::on_buffer_release(void *data, wl_buffer *buffer) {
+    (void)buffer;
+    auto *shm_buffer = static_cast<ShmBuffer*>(data);
+    shm_buffer->busy = false;
+
+    // A frame that found no free buffer
+    WaylandSurface *self = shm_buffer->owner;
+    if (self->render_requested && !self->frame_callback && self->render_idle_id == 0) {
+        self->render_idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE, on_render_idle, self, nullptr);
+    }
+}
+
+void WaylandSurface::on_frame_done(void *data, wl_callback *callback, uint32_t time) {
+    (void)time;
+    auto *self = static_cast<WaylandSurface*>(data);
+    wl_callback_destroy(callback);
+    self->frame_callback = nullptr;
+    if (self->render_requested) self->render();
+}
+
+void WaylandSurface::set_size(int new_width, int new_height) {
+    uint32_t anchor = 0;
+    if (new_width <= 0) anchor |= ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+    if (new_height <= 0) anchor |= ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
+
+    zwlr_layer_surface_v1_set_anchor(layer_surface, anchor);
+    zwlr_layer_surface_v1_set_size(layer_surface, std::max(new_width, 0), std::max(new_height, 0));
+    wl_surface_commit(surface);
+    wl_display_flush(connection.get_display());
+}
+
+void WaylandSurface::on_configure(void *data, zwlr_layer_surface_v1 *layer_surface, uint32_t serial,
+                                  uint32_t width, uint32_t height) {
+    auto *self = static_cast<WaylandSurface*>(data);
+    zwlr_layer_surface_v1_ack_configure(layer_surface, serial);
+
+    self->width = static_cast<int>(width);
+    self->height = static_cast<int>(height);
+    self->configured = true;
+    self->full_damage = true;
+    if (self->opaque_content && self->surface) self->set_opaque_region();
+
+    // Software buffers are reallocated at the new size on the next frame
+    if (self->egl_window) {
+        wl_egl_window_resize(self->egl_window, self->get_buffer_width(), self->get_buffer_height(), 0, 0);
+    }
+    if (self->egl_window || self->software_buffers) {
+        self->queue_render();
+    }
+}
+
+void WaylandSurface::on_closed(void *data, zwlr_layer_surface_v1 *layer_surface) {
+    (void)layer_surface;
+    auto *self = static_cast<WaylandSurface*>(data);
+    self->closed = true;
+    std::cout << "[" << self->output_name << "] Layer surface closed by the compositor" << std::endl;
+}